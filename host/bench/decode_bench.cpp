@@ -0,0 +1,122 @@
+// Decode cost per MB of the stream decoder, fed as streamDecodedBody() feeds it (1 KiB of input
+// at a time into 1 KiB chunks), for gzip and LZ4 on WAV-like and highly compressible data.
+//   decode_bench [--megabytes 8]
+// gzip inflates with zlib here, not the ESP32 ROM's tinfl, so its numbers are zlib's and the output
+// says so; the LZ4 decoder is the firmware's own code. On the device, each compressed download logs its ms/MB.
+#include "app.h"
+#include "lz4_encoder.h"
+#include <zlib.h>
+#include <cmath>
+#include <random>
+
+#define SLICE_SIZE 1024 // The firmware's chunk size
+
+// 16-bit stereo PCM: decaying tones with some noise, like a drum sample
+static std::string wavData(size_t size) {
+    std::string data(size & ~(size_t)3, '\0');
+    std::mt19937 generator(1);
+    std::normal_distribution<float> noise(0, 300);
+    for (size_t frame = 0; frame < data.size() / 4; frame++) {
+        float t = (frame % 22050) / 44100.0f; // A new hit every half second
+        float sample = 20000 * expf(-8 * t) * sinf(2 * (float)M_PI * 110 * t) + noise(generator);
+        int16_t value = (int16_t)std::max(-32768.0f, std::min(32767.0f, sample));
+        for (int channel = 0; channel < 2; channel++) memcpy(&data[frame * 4 + channel * 2], &value, 2);
+    }
+    return data;
+}
+
+static std::string textData(size_t size) {
+    std::string data;
+    char line[64];
+    for (int i = 0; data.size() < size; i++) {
+        snprintf(line, sizeof(line), "sample %d of the SP-404 bank, ", i / 50);
+        data += line;
+    }
+    data.resize(size);
+    return data;
+}
+
+static std::string gzipData(const std::string& data) {
+    z_stream stream = {};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// Microseconds to decode `encoded`, or 0 if it did not decode back to `expected`
+static unsigned long timeDecode(uint8_t encoding, const std::string& encoded, const std::string& expected) {
+    StreamDecoder* decoder = acquireStreamDecoder(encoding, 0);
+    if (!decoder) return 0;
+    std::string decoded;
+    decoded.reserve(expected.size());
+    uint8_t output[SLICE_SIZE];
+    size_t pos = 0;
+    bool ok = true;
+    unsigned long startMicros = micros();
+    for (;;) {
+        size_t inLength = std::min((size_t)SLICE_SIZE, encoded.size() - pos);
+        size_t outLength = sizeof(output);
+        bool inputEnds = pos + inLength == encoded.size();
+        if (streamDecode(decoder, (const uint8_t*)encoded.data() + pos, inLength, output, outLength, inputEnds) == DECODE_ERROR) {
+            ok = false;
+            break;
+        }
+        pos += inLength;
+        decoded.append((const char*)output, outLength);
+        if (pos == encoded.size() && outLength < sizeof(output)) break;
+    }
+    unsigned long elapsed = micros() - startMicros;
+    ok = ok && streamDecoderAtEnd(decoder) && decoded == expected;
+    releaseStreamDecoder(decoder);
+    return ok ? std::max(elapsed, 1UL) : 0;
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = 8;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--megabytes") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            megabytes = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--megabytes N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    struct Payload { const char* name; std::string data; } payloads[] = {
+        { "wav", wavData(megabytes << 20) },
+        { "text", textData(megabytes << 20) },
+    };
+    // The shim behind tinfl_decompress() is zlib: the ROM's own tinfl is not available off the device
+    Serial.println("[DecodeBench] gzip runs on zlib here, not the ESP32 ROM's tinfl: its ms/MB are zlib's, not the device's.");
+    bool ok = true;
+    for (const Payload& payload : payloads) {
+        const struct { const char* name; const char* decoder; uint8_t encoding; std::string encoded; } encodings[] = {
+            { "gzip", "zlib", CONTENT_ENCODING_GZIP, gzipData(payload.data) },
+            { "lz4", "firmware", CONTENT_ENCODING_LZ4, lz4CompressFrame((const uint8_t*)payload.data.data(), payload.data.size()) },
+        };
+        for (const auto& encoding : encodings) {
+            // Best of three, so a busy host does not count against the decoder
+            unsigned long bestMicros = 0;
+            for (int run = 0; run < 3; run++) {
+                unsigned long elapsed = timeDecode(encoding.encoding, encoding.encoded, payload.data);
+                if (elapsed == 0) ok = false;
+                if (bestMicros == 0 || (elapsed > 0 && elapsed < bestMicros)) bestMicros = elapsed;
+            }
+            double megabytesOut = payload.data.size() / 1048576.0;
+            char label[32];
+            snprintf(label, sizeof(label), "%s %s (%s)", encoding.name, payload.name, encoding.decoder);
+            Serial.printf("[DecodeBench] %-20s: %zu -> %zu bytes on the wire (%.1f%%), %.2f ms/MB decoded\n",
+                          label, payload.data.size(), encoding.encoded.size(),
+                          100.0 * encoding.encoded.size() / payload.data.size(), bestMicros / 1000.0 / megabytesOut);
+        }
+    }
+    if (!ok) Serial.println("[DecodeBench] Decoded output did not match.");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+// The firmware's pipeline benchmark on Linux: the download and write tasks fetch from a local HTTPS
+// stand-in for S3 and write to a simulated card, so settings can be compared without a board.
+//   pipeline_bench [--sizes 262144,1048576] [--handshake-ms 150] [--first-byte-ms 80] [--jitter-ms 40]
+//                  [--bandwidth-kbps 1200] [--card sdhc|slow|none] [--card-latency write=300,380,...]
+//                  [--dir bench_card] [--verbose]
+// Chunk, queue and worker settings are compile-time, as on the device:
+//   cmake -S host -B build -DFIRMWARE_DEFINES="DOWNLOAD_WORKER_COUNT=1;WRITE_COALESCE_SIZE=16384"
+#include "https_stand_in.h"
+#include "simulated_card.h"
+#include <unistd.h>
+#include <filesystem>
+#include <vector>
+
+// Kept without --verbose: the results, not the per-file log
+static bool isResultLine(const char* line) {
+    return strncmp(line, "[Benchmark]", 11) == 0 || strncmp(line, "[Latency]", 9) == 0 ||
+           strncmp(line, "[SimCard]", 9) == 0 || strncmp(line, "[StandIn]", 9) == 0 || strncmp(line, "[Bench]", 7) == 0;
+}
+
+// Deterministic bytes that do not compress, like the WAV data the device usually fetches
+static std::string objectBody(size_t size, uint32_t seed) {
+    std::string body(size, '\0');
+    std::mt19937 generator(seed);
+    for (size_t i = 0; i < size; i++) body[i] = (char)generator();
+    return body;
+}
+
+static bool parseSizes(const char* list, std::vector<size_t>& sizes) {
+    sizes.clear();
+    for (const char* p = list; *p;) {
+        char* end;
+        unsigned long long size = strtoull(p, &end, 10);
+        if (end == p || size == 0 || (*end != ',' && *end != '\0')) return false;
+        sizes.push_back(size);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !sizes.empty();
+}
+
+static int usage(const char* program) {
+    fprintf(stderr, "usage: %s [--sizes BYTES,...] [--handshake-ms MS] [--first-byte-ms MS] [--jitter-ms MS]\n"
+                    "       [--bandwidth-kbps KIB_PER_S] [--card none|sdhc|slow] [--card-latency OP=US,...]\n"
+                    "       [--dir DIRECTORY] [--verbose]\n", program);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = { 1048576 };
+    StandInOptions serverOptions;
+    SimulatedCardOptions cardOptions;
+    loadLatencyProfile("sdhc", cardOptions);
+    const char* directory = "bench_card";
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(option, "--verbose") == 0) {
+            verbose = true;
+            continue;
+        }
+        if (!value || strcmp(option, "--help") == 0) return usage(argv[0]);
+        i++;
+        if (strcmp(option, "--sizes") == 0) {
+            if (!parseSizes(value, sizes)) return usage(argv[0]);
+        } else if (strcmp(option, "--handshake-ms") == 0) {
+            serverOptions.handshakeDelayMs = atoi(value);
+        } else if (strcmp(option, "--first-byte-ms") == 0) {
+            serverOptions.firstByteMs = atoi(value);
+        } else if (strcmp(option, "--jitter-ms") == 0) {
+            serverOptions.firstByteJitterMs = atoi(value);
+        } else if (strcmp(option, "--bandwidth-kbps") == 0) {
+            serverOptions.bandwidthKiBps = atoi(value);
+        } else if (strcmp(option, "--card") == 0) {
+            if (!loadLatencyProfile(value, cardOptions)) return usage(argv[0]);
+        } else if (strcmp(option, "--card-latency") == 0) {
+            if (!parseLatencySpec(value, cardOptions)) return usage(argv[0]);
+        } else if (strcmp(option, "--dir") == 0) {
+            directory = value;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (!verbose) setSerialLineFilter(isResultLine);
+
+    // BENCHMARK_URL_FORMAT points at the stand-in's host name; every connection is routed to it
+    HttpsStandIn server(serverOptions);
+    char path[64];
+    for (int i = 1; i <= BENCHMARK_FILE_COUNT; i++) {
+        snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, i);
+        server.addObject(path, objectBody(sizes[(i - 1) % sizes.size()], i));
+    }
+    if (!server.start()) return 1;
+    routeConnectionsToPort(server.port());
+
+    std::filesystem::remove_all(directory);
+    SimulatedCard card(directory, cardOptions);
+    setStorageBackend(&card);
+    initFileDownloadHandler();
+    setupSD();
+    initSDPresence();
+    card.resetStats();
+
+    runPipelineBenchmark();
+
+    card.logStats();
+    StandInStats serverStats;
+    server.getStats(serverStats);
+    Serial.printf("[StandIn] %lu connections, %lu requests, %llu body bytes\n", (unsigned long)serverStats.connections,
+                  (unsigned long)serverStats.requests, (unsigned long long)serverStats.bodyBytes);
+    PipelineStats stats;
+    getPipelineStats(stats);
+    bool allCompleted = stats.filesFailed == 0 && stats.filesCompleted == BENCHMARK_FILE_COUNT * BENCHMARK_ROUNDS;
+    if (!allCompleted) {
+        Serial.printf("[Bench] %lu files failed, %lu completed\n", (unsigned long)stats.filesFailed, (unsigned long)stats.filesCompleted);
+    }
+    // The firmware's tasks never return, so leave without running destructors under them
+    fflush(stdout);
+    _exit(allCompleted ? 0 : 1);
+}
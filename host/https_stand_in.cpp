@@ -0,0 +1,293 @@
+#include "https_stand_in.h"
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <zlib.h>
+
+#define SOCKET_POLL_MS      200   // How often idle connections look at `running`
+#define IDLE_TIMEOUT_MS     60000 // Idle keep-alive connections are closed after this
+#define SEND_TIMEOUT_MS     30000 // A client that stops reading fails the response after this
+#define MAX_REQUEST_SIZE    8192
+#define PACING_SLICE_BYTES  4096
+
+typedef std::chrono::steady_clock Clock;
+
+static void sleepMs(uint32_t ms) {
+    if (ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static void setSocketTimeout(int socket, int option, int ms) {
+    struct timeval timeout = { ms / 1000, (ms % 1000) * 1000 };
+    setsockopt(socket, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+// A fresh P-256 key and a self-signed certificate for it; the firmware's host client does not verify
+static bool useSelfSignedCertificate(SSL_CTX* context) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* certificate = X509_new();
+    bool ok = key && certificate;
+    if (ok) {
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+        X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 3600);
+        X509_set_pubkey(certificate, key);
+        X509_NAME* name = X509_get_subject_name(certificate);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+        X509_set_issuer_name(certificate, name);
+        ok = X509_sign(certificate, key, EVP_sha256()) > 0 && SSL_CTX_use_certificate(context, certificate) == 1 &&
+             SSL_CTX_use_PrivateKey(context, key) == 1;
+    }
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+HttpsStandIn::HttpsStandIn(const StandInOptions& options) : options(options), random(options.seed) {}
+
+HttpsStandIn::~HttpsStandIn() {
+    stop();
+    SSL_CTX_free(context);
+}
+
+bool HttpsStandIn::start() {
+    signal(SIGPIPE, SIG_IGN); // A write to a client that left fails instead of ending the process
+    if (!context) {
+        context = SSL_CTX_new(TLS_server_method());
+        if (!context || !useSelfSignedCertificate(context)) {
+            Serial.printf("[StandIn] Certificate setup failed: %s\n", ERR_error_string(ERR_get_error(), nullptr));
+            return false;
+        }
+    }
+
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (listenSocket < 0 || bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listenSocket, 16) != 0 || getsockname(listenSocket, (struct sockaddr*)&address, &addressLength) != 0) {
+        Serial.printf("[StandIn] Listen failed: %s\n", strerror(errno));
+        if (listenSocket >= 0) close(listenSocket);
+        listenSocket = -1;
+        return false;
+    }
+    listenPort = ntohs(address.sin_port);
+    running = true;
+    acceptThread = std::thread(&HttpsStandIn::acceptLoop, this);
+    Serial.printf("[StandIn] Listening on 127.0.0.1:%u\n", listenPort);
+    return true;
+}
+
+void HttpsStandIn::stop() {
+    if (!running) return;
+    running = false;
+    shutdown(listenSocket, SHUT_RDWR); // Wakes up accept()
+    acceptThread.join();
+    close(listenSocket);
+    listenSocket = -1;
+    while (openConnections > 0) sleepMs(10);
+}
+
+void HttpsStandIn::addObject(const char* path, const std::string& body, const char* contentEncoding) {
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%08lx%08zx\"", crc32(0, (const Bytef*)body.data(), body.size()), body.size());
+    std::lock_guard<std::mutex> guard(lock);
+    objects[path] = { body, etag, contentEncoding ? contentEncoding : "" };
+}
+
+void HttpsStandIn::getStats(StandInStats& stats) {
+    std::lock_guard<std::mutex> guard(lock);
+    stats = this->stats;
+}
+
+void HttpsStandIn::setFirstByteDelay(uint32_t ms) {
+    std::lock_guard<std::mutex> guard(lock);
+    options.firstByteMs = ms;
+}
+
+uint32_t HttpsStandIn::firstByteDelayMs() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (options.firstByteJitterMs == 0) return options.firstByteMs;
+    return options.firstByteMs + random() % (options.firstByteJitterMs + 1);
+}
+
+void HttpsStandIn::acceptLoop() {
+    while (running) {
+        int socket = accept(listenSocket, nullptr, nullptr);
+        if (socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break; // Shut down by stop()
+        }
+        openConnections++;
+        std::thread(&HttpsStandIn::serveConnection, this, socket).detach();
+    }
+}
+
+void HttpsStandIn::serveConnection(int socket) {
+    setSocketTimeout(socket, SO_RCVTIMEO, SOCKET_POLL_MS);
+    setSocketTimeout(socket, SO_SNDTIMEO, SEND_TIMEOUT_MS);
+    sleepMs(options.handshakeDelayMs);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stats.connections++;
+    }
+
+    SSL* ssl = SSL_new(context);
+    SSL_set_fd(ssl, socket);
+    Clock::time_point idleSince = Clock::now();
+    bool open = false;
+    while (running) {
+        int result = SSL_accept(ssl);
+        if (result == 1) {
+            open = true;
+            break;
+        }
+        if (SSL_get_error(ssl, result) != SSL_ERROR_WANT_READ ||
+            Clock::now() - idleSince > std::chrono::milliseconds(IDLE_TIMEOUT_MS)) break;
+    }
+
+    std::string pending;
+    while (open && running) {
+        size_t headerEnd = pending.find("\r\n\r\n");
+        if (headerEnd != std::string::npos) {
+            std::string request = pending.substr(0, headerEnd + 4);
+            pending.erase(0, headerEnd + 4);
+            open = handleRequest(ssl, request);
+            idleSince = Clock::now();
+            continue;
+        }
+        if (pending.size() > MAX_REQUEST_SIZE) break;
+
+        char buffer[4096];
+        int n = SSL_read(ssl, buffer, sizeof(buffer));
+        if (n > 0) {
+            pending.append(buffer, n);
+            continue;
+        }
+        if (SSL_get_error(ssl, n) != SSL_ERROR_WANT_READ) break; // Closed by the client
+        if (Clock::now() - idleSince > std::chrono::milliseconds(IDLE_TIMEOUT_MS)) break;
+    }
+    SSL_free(ssl);
+    close(socket);
+    openConnections--;
+}
+
+// Writes in slices, each no earlier than the bandwidth allows
+bool HttpsStandIn::sendPaced(SSL* ssl, const char* data, size_t length) {
+    Clock::time_point start = Clock::now();
+    size_t sent = 0;
+    while (sent < length) {
+        size_t slice = std::min(length - sent, (size_t)(options.bandwidthKiBps > 0 ? PACING_SLICE_BYTES : 16384));
+        if (SSL_write(ssl, data + sent, (int)slice) <= 0) return false;
+        sent += slice;
+        if (options.bandwidthKiBps > 0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t)sent * 1000000 / (options.bandwidthKiBps * 1024ULL)));
+        }
+    }
+    return true;
+}
+
+static std::string headerValue(const std::string& request, const char* name) {
+    size_t nameLength = strlen(name);
+    for (size_t line = request.find("\r\n"); line != std::string::npos && line + 2 < request.size(); line = request.find("\r\n", line + 2)) {
+        const char* start = request.c_str() + line + 2;
+        if (strncasecmp(start, name, nameLength) != 0 || start[nameLength] != ':') continue;
+        size_t valueStart = request.find_first_not_of(' ', line + 2 + nameLength + 1);
+        return request.substr(valueStart, request.find("\r\n", valueStart) - valueStart);
+    }
+    return std::string();
+}
+
+// "bytes=first-last" or "bytes=first-". False for anything else, which is served as a plain GET.
+static bool parseRange(const std::string& range, size_t& first, size_t& last) {
+    unsigned long long a, b;
+    char end;
+    if (sscanf(range.c_str(), "bytes=%llu-%llu%c", &a, &b, &end) == 2 && b >= a) {
+        first = a;
+        last = b;
+        return true;
+    }
+    if (sscanf(range.c_str(), "bytes=%llu-%c", &a, &end) == 1 && range.back() == '-') {
+        first = a;
+        last = SIZE_MAX;
+        return true;
+    }
+    return false;
+}
+
+bool HttpsStandIn::handleRequest(SSL* ssl, const std::string& request) {
+    char method[16] = "", path[4096] = "", version[16] = "";
+    sscanf(request.c_str(), "%15s %4095s %15s", method, path, version);
+    char* query = strchr(path, '?'); // Presigned URLs carry their signature here
+    if (query) *query = '\0';
+    bool keepAlive = strcmp(version, "HTTP/1.1") == 0 && strcasecmp(headerValue(request, "Connection").c_str(), "close") != 0;
+
+    Object object;
+    bool found;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stats.requests++;
+        auto entry = objects.find(path);
+        found = entry != objects.end();
+        if (found) object = entry->second;
+    }
+
+    int status = 200;
+    size_t first = 0, last = object.body.size() - 1;
+    std::string ifMatch = headerValue(request, "If-Match");
+    std::string ifRange = headerValue(request, "If-Range");
+    if (strcmp(method, "GET") != 0) {
+        status = 405;
+    } else if (!found) {
+        status = 404;
+    } else if (headerValue(request, "If-None-Match") == object.etag) {
+        status = 304;
+    } else if (!ifMatch.empty() && ifMatch != object.etag) {
+        status = 412;
+    } else if (parseRange(headerValue(request, "Range"), first, last) && (ifRange.empty() || ifRange == object.etag)) {
+        // A stale If-Range gets the whole current object, as from S3
+        if (first >= object.body.size()) {
+            status = 416;
+        } else {
+            status = 206;
+            last = std::min(last, object.body.size() - 1);
+        }
+    }
+
+    const char* reason = status == 200 ? "OK" : status == 206 ? "Partial Content" : status == 304 ? "Not Modified" :
+                         status == 404 ? "Not Found" : status == 405 ? "Method Not Allowed" :
+                         status == 412 ? "Precondition Failed" : "Range Not Satisfiable";
+    size_t bodyLength = status == 200 || status == 206 ? last - first + 1 : 0;
+    char headers[512];
+    int headerLength = snprintf(headers, sizeof(headers), "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\n", status, reason, bodyLength);
+    if (found) headerLength += snprintf(headers + headerLength, sizeof(headers) - headerLength, "ETag: %s\r\n", object.etag.c_str());
+    if (status == 206) {
+        headerLength += snprintf(headers + headerLength, sizeof(headers) - headerLength, "Content-Range: bytes %zu-%zu/%zu\r\n",
+                                 first, last, object.body.size());
+    } else if (status == 416) {
+        headerLength += snprintf(headers + headerLength, sizeof(headers) - headerLength, "Content-Range: bytes */%zu\r\n", object.body.size());
+    }
+    if (bodyLength > 0 && !object.contentEncoding.empty()) {
+        headerLength += snprintf(headers + headerLength, sizeof(headers) - headerLength, "Content-Encoding: %s\r\n", object.contentEncoding.c_str());
+    }
+    headerLength += snprintf(headers + headerLength, sizeof(headers) - headerLength, "Connection: %s\r\n\r\n", keepAlive ? "keep-alive" : "close");
+
+    sleepMs(firstByteDelayMs());
+    if (SSL_write(ssl, headers, headerLength) <= 0) return false;
+    if (bodyLength > 0 && !sendPaced(ssl, object.body.data() + first, bodyLength)) return false;
+    std::lock_guard<std::mutex> guard(lock);
+    stats.bodyBytes += bodyLength;
+    return keepAlive;
+}
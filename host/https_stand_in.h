@@ -0,0 +1,72 @@
+#pragma once
+// A local stand-in for S3 for the host programs: HTTPS with a self-signed certificate on the
+// loopback address, keep-alive, and the request headers the firmware relies on (Range, If-Range,
+// If-Match, If-None-Match). Handshakes, first bytes and bodies can be slowed down to look like
+// the device's Wi-Fi link.
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+
+struct StandInOptions {
+    uint32_t handshakeDelayMs = 0;  // Before each TLS handshake, e.g. the round trips to the server
+    uint32_t firstByteMs = 0;       // Before each response's headers
+    uint32_t firstByteJitterMs = 0; // Uniform [0, firstByteJitterMs] more
+    uint32_t bandwidthKiBps = 0;    // Per connection; 0 is unlimited
+    uint32_t seed = 1;
+};
+
+struct StandInStats {
+    uint32_t connections;
+    uint32_t requests;
+    uint64_t bodyBytes;
+};
+
+class HttpsStandIn {
+public:
+    explicit HttpsStandIn(const StandInOptions& options = StandInOptions());
+    ~HttpsStandIn();
+    HttpsStandIn(const HttpsStandIn&) = delete;
+    HttpsStandIn& operator=(const HttpsStandIn&) = delete;
+
+    // Listens on a free loopback port. False if the certificate or socket could not be set up.
+    bool start();
+    void stop(); // Closes the listener and waits for open connections to finish
+    uint16_t port() const { return listenPort; }
+
+    // Serves `body` at `path` with a fixed ETag, and Content-Encoding if one is given
+    void addObject(const char* path, const std::string& body, const char* contentEncoding = nullptr);
+    void getStats(StandInStats& stats);
+    void setFirstByteDelay(uint32_t ms); // For the responses that follow
+
+private:
+    struct Object {
+        std::string body;
+        std::string etag;
+        std::string contentEncoding;
+    };
+
+    void acceptLoop();
+    void serveConnection(int socket);
+    bool handleRequest(SSL* ssl, const std::string& request); // False to close the connection
+    bool sendPaced(SSL* ssl, const char* data, size_t length);
+    uint32_t firstByteDelayMs();
+
+    StandInOptions options;
+    SSL_CTX* context = nullptr;
+    int listenSocket = -1;
+    uint16_t listenPort = 0;
+    std::thread acceptThread;
+    std::atomic<bool> running{false};
+    std::atomic<int> openConnections{0};
+    std::mutex lock; // objects, random, stats and options.firstByteMs
+    std::map<std::string, Object> objects;
+    std::mt19937 random;
+    StandInStats stats = {};
+};
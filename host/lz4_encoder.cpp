@@ -0,0 +1,85 @@
+#include "lz4_encoder.h"
+#include <string.h>
+#include <vector>
+
+#define LZ4_FRAME_MAGIC      0x184D2204
+#define LZ4_BLOCK_MAX_SIZE   (4 * 1024 * 1024) // BD byte 0x70
+#define LZ4_MAX_OFFSET       65535
+#define LZ4_MIN_MATCH        4
+#define LZ4_LAST_LITERALS    5                 // A block ends with at least this many literals
+#define LZ4_MATCH_START_END  12                // and its last match starts this far from the end
+#define HASH_BITS            14
+
+static void appendLe32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out += (char)(value >> (8 * i));
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// The bytes after a length nibble of 15
+static void appendLength(std::string& out, size_t length) {
+    for (length -= 15; length >= 255; length -= 255) out += (char)255;
+    out += (char)length;
+}
+
+// Literals, then a match unless matchLength is 0 (the last sequence of a block)
+static void appendSequence(std::string& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - LZ4_MIN_MATCH : 0;
+    out += (char)(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalLength >= 15) appendLength(out, literalLength);
+    out.append((const char*)literals, literalLength);
+    if (matchLength == 0) return;
+    out += (char)offset;
+    out += (char)(offset >> 8);
+    if (matchCode >= 15) appendLength(out, matchCode);
+}
+
+static std::string compressBlock(const uint8_t* src, size_t n) {
+    std::string out;
+    std::vector<uint32_t> table(1 << HASH_BITS, 0); // Position + 1 of the last sequence with this hash
+    size_t anchor = 0, pos = 0;
+    size_t matchLimit = n > LZ4_MATCH_START_END ? n - LZ4_MATCH_START_END : 0;
+    while (pos < matchLimit) {
+        uint32_t sequence = read32(src + pos);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)pos + 1;
+        if (candidate == 0 || pos - (candidate - 1) > LZ4_MAX_OFFSET || read32(src + candidate - 1) != sequence) {
+            pos++;
+            continue;
+        }
+        size_t match = candidate - 1;
+        size_t length = LZ4_MIN_MATCH;
+        while (pos + length < n - LZ4_LAST_LITERALS && src[match + length] == src[pos + length]) length++;
+        appendSequence(out, src + anchor, pos - anchor, pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+    appendSequence(out, src + anchor, n - anchor, 0, 0);
+    return out;
+}
+
+std::string lz4CompressFrame(const uint8_t* data, size_t length) {
+    std::string frame;
+    appendLe32(frame, LZ4_FRAME_MAGIC);
+    frame += (char)0x60; // Version 1, independent blocks, no checksums or content size
+    frame += (char)0x70; // 4 MB blocks
+    frame += (char)0x73; // Header checksum of the two bytes above
+    for (size_t start = 0; start < length; start += LZ4_BLOCK_MAX_SIZE) {
+        size_t blockLength = length - start < LZ4_BLOCK_MAX_SIZE ? length - start : LZ4_BLOCK_MAX_SIZE;
+        std::string block = compressBlock(data + start, blockLength);
+        if (block.size() >= blockLength) { // Stored as is
+            appendLe32(frame, (uint32_t)blockLength | 0x80000000);
+            frame.append((const char*)data + start, blockLength);
+        } else {
+            appendLe32(frame, (uint32_t)block.size());
+            frame += block;
+        }
+    }
+    appendLe32(frame, 0); // End mark
+    return frame;
+}
@@ -0,0 +1,8 @@
+#pragma once
+// LZ4 frames for the host tests and benchmarks, which have no liblz4: greedy matching with a
+// hash of 4-byte sequences, independent blocks, no checksums. Decodes with any LZ4 frame reader.
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+std::string lz4CompressFrame(const uint8_t* data, size_t length);
@@ -0,0 +1,12 @@
+#pragma once
+#include <Arduino.h>
+
+// Host build: drawing goes nowhere
+class Adafruit_GFX : public Print {
+public:
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+    void setCursor(int16_t, int16_t) {}
+    void setTextColor(uint16_t) {}
+    void setTextSize(uint8_t) {}
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include "Adafruit_GFX.h"
+#include "Wire.h"
+
+#define SSD1306_BLACK        0
+#define SSD1306_WHITE        1
+#define SSD1306_SWITCHCAPVCC 0x02
+
+class Adafruit_SSD1306 : public Adafruit_GFX {
+public:
+    Adafruit_SSD1306(int8_t resetPin = -1) { (void)resetPin; }
+    bool begin(uint8_t vccState = SSD1306_SWITCHCAPVCC, uint8_t address = 0) {
+        (void)vccState, (void)address;
+        return true;
+    }
+    void clearDisplay() {}
+    void display() {}
+    void invertDisplay(bool) {}
+};
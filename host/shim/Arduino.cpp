@@ -0,0 +1,144 @@
+#include <Arduino.h>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#define HOST_FREE_HEAP (180 * 1024) // Roughly what the firmware has left once WiFi is up
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const auto bootTime = std::chrono::steady_clock::now();
+static std::mutex serialLock;
+static bool (*serialLineFilter)(const char* line) = nullptr;
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+long random(long max) {
+    return random(0, max);
+}
+
+long random(long min, long max) {
+    static thread_local std::mt19937 generator(std::random_device{}());
+    if (max <= min) return min;
+    return std::uniform_int_distribution<long>(min, max - 1)(generator);
+}
+
+// No GPIOs on the host: pins read high, i.e. an open card-detect switch with its pull-up
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
+int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(uint8_t, void (*)(), int) {}
+
+uint32_t EspClass::getFreeHeap() { return HOST_FREE_HEAP; }
+uint32_t EspClass::getMinFreeHeap() { return HOST_FREE_HEAP; }
+bool psramFound() { return false; }
+
+void String::trim() {
+    size_t start = value.find_first_not_of(" \t\r\n");
+    size_t end = value.find_last_not_of(" \t\r\n");
+    value = start == std::string::npos ? std::string() : value.substr(start, end - start + 1);
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n])) n++;
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char small[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    if ((size_t)length < sizeof(small)) return write((const uint8_t*)small, length);
+    std::string large(length + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&large[0], large.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)large.data(), length);
+}
+
+size_t Print::print(long number, int base) {
+    if (number < 0 && base == 10) return print('-') + print((unsigned long)-number, base);
+    return print((unsigned long)number, base);
+}
+
+size_t Print::print(unsigned long number, int base) {
+    return print((unsigned long long)number, base);
+}
+
+size_t Print::print(long long number, int base) {
+    if (number < 0 && base == 10) return print('-') + print((unsigned long long)-number, base);
+    return print((unsigned long long)number, base);
+}
+
+size_t Print::print(unsigned long long number, int base) {
+    char digits[66];
+    char* p = digits + sizeof(digits) - 1;
+    *p = '\0';
+    if (base < 2) base = 10;
+    do {
+        int digit = number % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        number /= base;
+    } while (number > 0);
+    return write(p);
+}
+
+size_t Print::print(double number, int digits) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", digits, number);
+    return write(text);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    unsigned long startMillis = millis();
+    while (count < length && millis() - startMillis < timeout) {
+        int c = read();
+        if (c < 0) {
+            delay(1);
+            continue;
+        }
+        buffer[count++] = (uint8_t)c;
+    }
+    return count;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    static thread_local std::string line;
+    for (size_t i = 0; i < size; i++) {
+        line += (char)buffer[i];
+        if (buffer[i] != '\n') continue;
+        std::lock_guard<std::mutex> guard(serialLock);
+        if (!serialLineFilter || serialLineFilter(line.c_str())) {
+            fwrite(line.data(), 1, line.size(), stdout);
+            fflush(stdout);
+        }
+        line.clear();
+    }
+    return size;
+}
+
+void setSerialLineFilter(bool (*keep)(const char* line)) {
+    std::lock_guard<std::mutex> guard(serialLock);
+    serialLineFilter = keep;
+}
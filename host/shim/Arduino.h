@@ -0,0 +1,129 @@
+#pragma once
+// Host build: the part of the Arduino core the firmware modules use, on POSIX
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define F(string) string
+#define IRAM_ATTR
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define INPUT_PULLUP 0x05
+#define CHANGE 0x03
+
+class String {
+public:
+    String() {}
+    String(const char* text) : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned number) : value(std::to_string(number)) {}
+    explicit String(long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    const char* c_str() const { return value.c_str(); }
+    unsigned length() const { return value.size(); }
+    String& operator+=(char c) { value += c; return *this; }
+    String& operator+=(const char* text) { value += text; return *this; }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    bool operator==(const char* text) const { return value == text; }
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator!=(const char* text) const { return value != text; }
+    char operator[](unsigned index) const { return value[index]; }
+    bool equalsIgnoreCase(const String& other) const { return strcasecmp(value.c_str(), other.c_str()) == 0; }
+    int indexOf(char c) const { size_t at = value.find(c); return at == std::string::npos ? -1 : (int)at; }
+    String substring(unsigned from) const { return String(value.substr(from)); }
+    String substring(unsigned from, unsigned to) const { return String(value.substr(from, to - from)); }
+    long toInt() const { return atol(value.c_str()); }
+    void trim();
+
+private:
+    std::string value;
+};
+
+inline String operator+(const String& a, const String& b) { String result(a); result += b; return result; }
+inline String operator+(const String& a, const char* b) { String result(a); result += b; return result; }
+inline String operator+(const char* a, const String& b) { String result(a); result += b; return result; }
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int number, int base = 10) { return print((long)number, base); }
+    size_t print(unsigned number, int base = 10) { return print((unsigned long)number, base); }
+    size_t print(long number, int base = 10);
+    size_t print(unsigned long number, int base = 10);
+    size_t print(long long number, int base = 10);
+    size_t print(unsigned long long number, int base = 10);
+    size_t print(double number, int digits = 2);
+    size_t println() { return write("\n"); }
+    template <typename T> size_t println(const T& value) { return print(value) + println(); }
+    template <typename T> size_t println(const T& value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    void setTimeout(unsigned long timeoutMs) { timeout = timeoutMs; }
+    size_t readBytes(uint8_t* buffer, size_t length);
+
+protected:
+    unsigned long timeout = 1000;
+};
+
+// Whole lines go to stdout, so lines from different tasks never interleave
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+// Host only: lines for which `keep` returns false are dropped; nullptr prints everything
+void setSerialLineFilter(bool (*keep)(const char* line));
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long max);
+long random(long min, long max);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+
+class EspClass {
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+    uint32_t getPsramSize() { return 0; }
+    uint32_t getFreePsram() { return 0; }
+    uint64_t getEfuseMac() { return 0x24A160000000ULL; }
+};
+
+extern EspClass ESP;
+bool psramFound();
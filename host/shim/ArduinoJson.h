@@ -0,0 +1,25 @@
+#pragma once
+#include <Arduino.h>
+
+// Host build: documents accept any assignment and serialize as an empty object. Nothing is published.
+class JsonVariant {
+public:
+    template <typename T> JsonVariant& operator=(const T&) { return *this; }
+    JsonVariant operator[](const char*) { return JsonVariant(); }
+};
+
+template <size_t capacity>
+class StaticJsonDocument {
+public:
+    JsonVariant operator[](const char*) { return JsonVariant(); }
+};
+
+template <size_t capacity>
+size_t serializeJson(const StaticJsonDocument<capacity>&, char* output, size_t outputSize) {
+    return snprintf(output, outputSize, "{}");
+}
+
+template <size_t capacity, size_t outputSize>
+size_t serializeJson(const StaticJsonDocument<capacity>& doc, char (&output)[outputSize]) {
+    return serializeJson(doc, output, outputSize);
+}
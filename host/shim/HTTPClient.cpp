@@ -0,0 +1,143 @@
+#include <HTTPClient.h>
+#include <strings.h>
+#include <algorithm>
+
+#define HEADER_POLL_MS 10 // What the Arduino client sleeps while a response has not arrived
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+    const char* text = url.c_str();
+    if (strncmp(text, "https://", 8) != 0) return false;
+    const char* start = text + 8;
+    size_t hostLength = strcspn(start, ":/?");
+    if (hostLength == 0) return false;
+    host.assign(start, hostLength);
+    port = 443;
+    const char* rest = start + hostLength;
+    if (*rest == ':') {
+        port = (uint16_t)atoi(rest + 1);
+        rest += 1 + strspn(rest + 1, "0123456789");
+    }
+    path = *rest == '/' ? rest : std::string("/") + rest;
+    this->client = &client;
+    requestHeaders.clear();
+    size = -1;
+    return true;
+}
+
+void HTTPClient::end() {
+    // Unlike the Arduino client, which discards what is buffered and keeps the connection, a body
+    // that was not read to the end always closes it, so its rest never reaches the next request
+    if (client && client->connected() && (client->available() > 0 || !(reuseConnection && canReuse))) client->stop();
+    client = nullptr;
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+    requestHeaders += std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+    collected.clear();
+    for (size_t i = 0; i < headerKeysCount; i++) collected.emplace_back(headerKeys[i], "");
+}
+
+String HTTPClient::header(const char* name) {
+    for (const auto& entry : collected) {
+        if (strcasecmp(entry.first.c_str(), name) == 0) return String(entry.second);
+    }
+    return String();
+}
+
+bool HTTPClient::connected() {
+    return client && (client->available() > 0 || client->connected());
+}
+
+int HTTPClient::GET() {
+    if (!client) return HTTPC_ERROR_NOT_CONNECTED;
+    if (client->connected()) {
+        while (client->available() > 0) client->read(); // Left over from an earlier response
+    } else if (!client->connect(host.c_str(), port)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nUser-Agent: ESP32HTTPClient\r\n";
+    request += reuseConnection ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    request += requestHeaders + "\r\n";
+    if (client->write((const uint8_t*)request.data(), request.size()) != request.size()) return HTTPC_ERROR_SEND_HEADER_FAILED;
+    return readResponseHeaders();
+}
+
+// One header line without its CRLF. False if the connection closed or went quiet first.
+bool HTTPClient::readLine(std::string& line) {
+    line.clear();
+    unsigned long lastDataAt = millis();
+    while (connected()) {
+        int c = client->read();
+        if (c < 0) {
+            if (millis() - lastDataAt > tcpTimeoutMs) return false;
+            delay(HEADER_POLL_MS);
+            continue;
+        }
+        lastDataAt = millis();
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+        line += (char)c;
+    }
+    return false;
+}
+
+int HTTPClient::readResponseHeaders() {
+    for (auto& entry : collected) entry.second.clear();
+    size = -1;
+    canReuse = reuseConnection;
+    std::string line;
+    if (!readLine(line)) return connected() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    if (line.compare(0, 5, "HTTP/") != 0 || line.size() < 12) return HTTPC_ERROR_NO_HTTP_SERVER;
+    if (line.compare(0, 8, "HTTP/1.0") == 0) canReuse = false;
+    int code = atoi(line.c_str() + 9);
+
+    while (readLine(line)) {
+        if (line.empty()) return code;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        size_t valueStart = line.find_first_not_of(' ', colon + 1);
+        std::string value = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+        if (strcasecmp(name.c_str(), "Content-Length") == 0) size = atoi(value.c_str());
+        if (strcasecmp(name.c_str(), "Connection") == 0 && value.find("close") != std::string::npos) canReuse = false;
+        for (auto& entry : collected) {
+            if (strcasecmp(entry.first.c_str(), name.c_str()) == 0) entry.second = value;
+        }
+    }
+    return connected() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+}
+
+String HTTPClient::getString() {
+    std::string body;
+    uint8_t buffer[512];
+    unsigned long lastDataAt = millis();
+    while (connected() && (size < 0 || (int)body.size() < size) && millis() - lastDataAt <= tcpTimeoutMs) {
+        size_t wanted = size < 0 ? sizeof(buffer) : std::min(sizeof(buffer), (size_t)(size - body.size()));
+        int n = client->read(buffer, wanted);
+        if (n <= 0) {
+            delay(1);
+            continue;
+        }
+        body.append((const char*)buffer, n);
+        lastDataAt = millis();
+    }
+    return String(body);
+}
+
+String HTTPClient::errorToString(int error) {
+    switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return String("connection refused");
+    case HTTPC_ERROR_SEND_HEADER_FAILED: return String("send header failed");
+    case HTTPC_ERROR_NOT_CONNECTED: return String("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST: return String("connection lost");
+    case HTTPC_ERROR_NO_HTTP_SERVER: return String("no HTTP server");
+    case HTTPC_ERROR_READ_TIMEOUT: return String("read Timeout");
+    default: return String();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+// Host build: the part of arduino-esp32's HTTPClient the download path uses. HTTP/1.1 over a
+// caller-supplied client, Content-Length bodies only, read by the caller from getStreamPtr().
+#include <Arduino.h>
+#include "WiFiClient.h"
+#include <string>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT  5000
+
+#define HTTP_CODE_OK                    200
+#define HTTP_CODE_PARTIAL_CONTENT       206
+#define HTTP_CODE_NOT_MODIFIED          304
+#define HTTP_CODE_PRECONDITION_FAILED   412
+#define HTTP_CODE_RANGE_NOT_SATISFIABLE 416
+
+class HTTPClient {
+public:
+    bool begin(WiFiClient& client, const String& url);
+    void end();
+    void setReuse(bool reuse) { reuseConnection = reuse; }
+    void setTimeout(uint16_t timeoutMs) { tcpTimeoutMs = timeoutMs; }
+    void addHeader(const String& name, const String& value);
+    void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
+    String header(const char* name);
+    int GET();
+    int getSize() { return size; }
+    String getString();
+    WiFiClient* getStreamPtr() { return connected() ? client : nullptr; }
+    bool connected();
+    static String errorToString(int error);
+
+private:
+    bool readLine(std::string& line);
+    int readResponseHeaders();
+
+    WiFiClient* client = nullptr;
+    std::string host;
+    uint16_t port = 443;
+    std::string path;
+    std::string requestHeaders;
+    std::vector<std::pair<std::string, std::string>> collected;
+    bool reuseConnection = true;
+    bool canReuse = false;
+    int size = -1;
+    uint16_t tcpTimeoutMs = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
+};
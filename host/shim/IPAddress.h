@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+class IPAddress {
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    uint8_t operator[](int index) const { return bytes[index]; }
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return String(text);
+    }
+
+private:
+    uint8_t bytes[4] = {0, 0, 0, 0};
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include "WiFiClient.h"
+
+// Host build: there is no broker, so nothing is ever connected or published
+class PubSubClient {
+public:
+    PubSubClient(Client& client) { (void)client; }
+    bool connect(const char*) { return false; }
+    bool connected() { return false; }
+    bool publish(const char*, const char*) { return false; }
+    bool subscribe(const char*) { return false; }
+    bool loop() { return false; }
+    void disconnect() {}
+};
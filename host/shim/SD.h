@@ -0,0 +1,23 @@
+#pragma once
+// Host build: there is no card, so begin() always fails. Host programs install another storage backend.
+#include "FS.h"
+#include "SPI.h"
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+class SDFS : public fs::FS {
+public:
+    SDFS() : fs::FS(fs::FSImplPtr()) {}
+    bool begin(uint8_t ssPin = 5, SPIClass& spi = SPI, uint32_t frequency = 4000000, const char* mountpoint = "/sd",
+               uint8_t maxFiles = 5, bool formatIfEmpty = false) {
+        (void)ssPin, (void)spi, (void)frequency, (void)mountpoint, (void)maxFiles, (void)formatIfEmpty;
+        return false;
+    }
+    void end() {}
+    sdcard_type_t cardType() { return CARD_NONE; }
+    uint64_t cardSize() { return 0; }
+    uint64_t totalBytes() { return 0; }
+    uint64_t usedBytes() { return 0; }
+};
+
+extern SDFS SD;
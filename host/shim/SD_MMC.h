@@ -0,0 +1,24 @@
+#pragma once
+// Host build: no SDMMC peripheral either
+#include "FS.h"
+#include "SD.h"
+
+#define SDMMC_FREQ_DEFAULT   20000
+#define SDMMC_FREQ_HIGHSPEED 40000
+
+class SDMMCFS : public fs::FS {
+public:
+    SDMMCFS() : fs::FS(fs::FSImplPtr()) {}
+    bool begin(const char* mountpoint = "/sdcard", bool mode1bit = false, bool formatIfMountFailed = false,
+               int sdmmcFrequency = SDMMC_FREQ_DEFAULT, uint8_t maxOpenFiles = 5) {
+        (void)mountpoint, (void)mode1bit, (void)formatIfMountFailed, (void)sdmmcFrequency, (void)maxOpenFiles;
+        return false;
+    }
+    void end() {}
+    sdcard_type_t cardType() { return CARD_NONE; }
+    uint64_t cardSize() { return 0; }
+    uint64_t totalBytes() { return 0; }
+    uint64_t usedBytes() { return 0; }
+};
+
+extern SDMMCFS SD_MMC;
@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+
+class SPIClass {
+public:
+    void begin() {}
+    void end() {}
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,22 @@
+#pragma once
+// Host build: always connected. Every host name resolves to the loopback address.
+#include <Arduino.h>
+#include "IPAddress.h"
+
+#define WL_IDLE_STATUS   0
+#define WL_CONNECTED     3
+#define WL_DISCONNECTED  6
+
+class WiFiClass {
+public:
+    void begin(const char*, const char*) {}
+    int status() { return WL_CONNECTED; }
+    int hostByName(const char* host, IPAddress& address);
+};
+
+extern WiFiClass WiFi;
+
+// Host only: connections to any port go to this port on the loopback address instead, e.g. to a
+// stand-in for the real server. 0, the default, keeps the requested port.
+void routeConnectionsToPort(uint16_t port);
+uint16_t routedPort(uint16_t port);
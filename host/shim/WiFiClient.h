@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+#include "IPAddress.h"
+
+class Client : public Stream {
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* host, uint16_t port) = 0;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size) override = 0;
+    using Print::write;
+    virtual int read(uint8_t* buf, size_t size) = 0;
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    virtual operator bool() { return connected(); }
+};
+
+// Host build: only TLS connections are supported, through WiFiClientSecure
+class WiFiClient : public Client {
+public:
+    int connect(IPAddress, uint16_t) override { return 0; }
+    int connect(const char*, uint16_t) override { return 0; }
+    size_t write(const uint8_t*, size_t) override { return 0; }
+    using Client::write;
+    int available() override { return 0; }
+    int read(uint8_t*, size_t) override { return -1; }
+    using Client::read;
+    uint8_t connected() override { return 0; }
+    void stop() override {}
+};
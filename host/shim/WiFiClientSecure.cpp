@@ -0,0 +1,170 @@
+#include <WiFiClientSecure.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define RECEIVE_BUFFER_SIZE (16 * 1024 + 512) // One TLS record
+#define IO_TIMEOUT_MS       30000             // For writes; reads never block
+
+WiFiClass WiFi;
+static uint16_t routedToPort = 0;
+
+int WiFiClass::hostByName(const char*, IPAddress& address) {
+    address = IPAddress(127, 0, 0, 1);
+    return 1;
+}
+
+void routeConnectionsToPort(uint16_t port) {
+    routedToPort = port;
+}
+
+uint16_t routedPort(uint16_t port) {
+    return routedToPort ? routedToPort : port;
+}
+
+static SSL_CTX* clientContext() {
+    static std::once_flag once;
+    static SSL_CTX* context = nullptr;
+    std::call_once(once, [] {
+        signal(SIGPIPE, SIG_IGN); // A write to a closed connection fails instead of ending the process
+        context = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_verify(context, SSL_VERIFY_NONE, nullptr);
+    });
+    return context;
+}
+
+// Waits until the socket can do what the last SSL call wanted. False on timeout.
+static bool waitForSocket(SSL* ssl, int socket, int result, unsigned long timeoutMs) {
+    int error = SSL_get_error(ssl, result);
+    if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) return false;
+    struct pollfd pfd = { socket, (short)(error == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT), 0 };
+    return poll(&pfd, 1, (int)timeoutMs) > 0;
+}
+
+WiFiClientSecure::WiFiClientSecure() : sslclient(new sslclient_context), receiveBuffer(new uint8_t[RECEIVE_BUFFER_SIZE]) {}
+
+WiFiClientSecure::~WiFiClientSecure() {
+    disconnect();
+    delete sslclient;
+    delete[] receiveBuffer;
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port) {
+    IPAddress address;
+    if (!WiFi.hostByName(host, address)) return 0;
+    return connect(address, port, host, nullptr, nullptr, nullptr);
+}
+
+int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char* host, const char*, const char*, const char*) {
+    disconnect();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // As lwIP does for the ESP32's TLS client
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(routedPort(port));
+    address.sin_addr.s_addr = htonl(((uint32_t)ip[0] << 24) | (ip[1] << 16) | (ip[2] << 8) | ip[3]);
+    if (::connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return 0;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    SSL* ssl = SSL_new(clientContext());
+    SSL_set_fd(ssl, fd);
+    if (host) SSL_set_tlsext_host_name(ssl, host);
+    sslclient->socket = fd;
+    sslclient->ssl = ssl;
+    unsigned long startMillis = millis();
+    for (;;) {
+        int result = SSL_connect(ssl);
+        if (result == 1) break;
+        unsigned long waited = millis() - startMillis;
+        if (waited >= handshakeTimeoutMs || !waitForSocket(ssl, fd, result, handshakeTimeoutMs - waited)) {
+            ERR_clear_error();
+            disconnect();
+            return 0;
+        }
+    }
+    isConnected = true;
+    return 1;
+}
+
+size_t WiFiClientSecure::write(const uint8_t* buf, size_t size) {
+    if (!isConnected) return 0;
+    size_t written = 0;
+    while (written < size) {
+        int result = SSL_write(sslclient->ssl, buf + written, (int)(size - written));
+        if (result > 0) {
+            written += result;
+        } else if (!waitForSocket(sslclient->ssl, sslclient->socket, result, IO_TIMEOUT_MS)) {
+            ERR_clear_error();
+            disconnect();
+            break;
+        }
+    }
+    return written;
+}
+
+bool WiFiClientSecure::fillReceiveBuffer() {
+    if (!isConnected) return false;
+    if (receiveStart == receiveEnd) receiveStart = receiveEnd = 0;
+    if (receiveEnd == RECEIVE_BUFFER_SIZE) return true;
+    int result = SSL_read(sslclient->ssl, receiveBuffer + receiveEnd, (int)(RECEIVE_BUFFER_SIZE - receiveEnd));
+    if (result > 0) {
+        receiveEnd += result;
+        return true;
+    }
+    int error = SSL_get_error(sslclient->ssl, result);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) return true;
+    ERR_clear_error();
+    isConnected = false; // Closed or failed; what is buffered can still be read
+    return false;
+}
+
+int WiFiClientSecure::available() {
+    if (receiveStart == receiveEnd) fillReceiveBuffer();
+    return (int)(receiveEnd - receiveStart);
+}
+
+int WiFiClientSecure::read(uint8_t* buf, size_t size) {
+    int ready = available();
+    if (ready <= 0) return -1;
+    size_t n = std::min(size, (size_t)ready);
+    memcpy(buf, receiveBuffer + receiveStart, n);
+    receiveStart += n;
+    return (int)n;
+}
+
+int WiFiClientSecure::peek() {
+    return available() > 0 ? receiveBuffer[receiveStart] : -1;
+}
+
+uint8_t WiFiClientSecure::connected() {
+    if (receiveStart != receiveEnd) return 1;
+    if (isConnected) fillReceiveBuffer(); // Notices a close
+    return isConnected || receiveStart != receiveEnd;
+}
+
+void WiFiClientSecure::stop() {
+    disconnect();
+}
+
+void WiFiClientSecure::disconnect() {
+    if (sslclient->ssl) SSL_free(sslclient->ssl);
+    if (sslclient->socket >= 0) close(sslclient->socket);
+    sslclient->ssl = nullptr;
+    sslclient->socket = -1;
+    isConnected = false;
+    receiveStart = receiveEnd = 0;
+}
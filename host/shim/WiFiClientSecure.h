@@ -0,0 +1,50 @@
+#pragma once
+// Host build: TLS over OpenSSL on a non-blocking socket. Certificates are not verified; the servers
+// the host programs talk to are local stand-ins with self-signed certificates.
+#include "WiFiClient.h"
+#include "WiFi.h"
+
+typedef struct ssl_st SSL;
+
+struct sslclient_context {
+    int socket = -1;
+    SSL* ssl = nullptr;
+};
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    WiFiClientSecure();
+    ~WiFiClientSecure();
+    WiFiClientSecure(const WiFiClientSecure&) = delete;
+    WiFiClientSecure& operator=(const WiFiClientSecure&) = delete;
+
+    int connect(IPAddress ip, uint16_t port) override { return connect(ip, port, nullptr, nullptr, nullptr, nullptr); }
+    int connect(const char* host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, const char* host, const char* rootCA, const char* clientCert, const char* privateKey);
+    size_t write(const uint8_t* buf, size_t size) override;
+    using Client::write;
+    int available() override;
+    int read(uint8_t* buf, size_t size) override;
+    using Client::read;
+    int peek() override;
+    void flush() override {}
+    uint8_t connected() override;
+    void stop() override;
+
+    void setCACert(const char*) {}
+    void setInsecure() {}
+    void setHandshakeTimeout(unsigned long seconds) { handshakeTimeoutMs = seconds * 1000; }
+
+protected:
+    sslclient_context* sslclient;
+
+private:
+    bool fillReceiveBuffer(); // Reads what the socket has without blocking; false once the peer closed
+    void disconnect();
+
+    bool isConnected = false;
+    unsigned long handshakeTimeoutMs = 120000;
+    uint8_t* receiveBuffer;
+    size_t receiveStart = 0;
+    size_t receiveEnd = 0;
+};
@@ -0,0 +1,16 @@
+// Host build: the globals main.cpp defines on the device
+#include "app.h"
+#include <SD_MMC.h>
+
+bool isDeviceRegistered = false;
+bool receivedRegStatus = false;
+
+Adafruit_SSD1306 display(-1);
+WiFiClientSecure net;
+PubSubClient client(net);
+HTTPClient https;
+
+SDFS SD;
+SDMMCFS SD_MMC;
+SPIClass SPI;
+TwoWire Wire;
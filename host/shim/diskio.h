@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+typedef uint8_t BYTE;
+typedef BYTE DSTATUS;
+#define STA_NOINIT  0x01
+#define STA_NODISK  0x02
+
+DSTATUS disk_status(BYTE pdrv);
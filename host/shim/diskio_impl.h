@@ -0,0 +1,9 @@
+#pragma once
+// Host build: no FATFS drives are registered
+#include "diskio.h"
+
+typedef int esp_err_t;
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+esp_err_t ff_diskio_get_drive(BYTE* out_pdrv);
@@ -0,0 +1,5 @@
+#pragma once
+// Host build: the ROM CRC-32 is the zlib one
+#include <stdint.h>
+
+uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
@@ -0,0 +1,48 @@
+#pragma once
+// Host build: the ROM's tinfl_decompress, implemented over zlib's inflate. Same contract as tinfl
+// with a wrapping output buffer: output goes to [pOut_buf_next, +*pOut_buf_size), *pIn_buf_size and
+// *pOut_buf_size return what was consumed and produced, and a full output buffer returns
+// TINFL_STATUS_HAS_MORE_OUTPUT while zlib may still hold output for the next call, even when all
+// of the input has been taken.
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8,
+};
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_HOST_ARENA_SIZE (48 * 1024) // zlib's inflate state and window
+
+// Like tinfl's, this is allocated raw and set up by tinfl_init. zlib allocates from the arena, so
+// freeing the struct frees everything and tinfl_init may simply start over.
+typedef struct {
+    mz_uint32 m_state;          // 0 after tinfl_init
+    size_t arenaUsed;
+    z_stream stream;
+    mz_uint8 lookahead[4];      // Input taken but not yet decoded, as in tinfl's bit buffer
+    size_t lookaheadLength;
+    alignas(16) unsigned char arena[TINFL_HOST_ARENA_SIZE];
+} tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->m_state = 0; } while (0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                              mz_uint8* pOut_buf_start, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                              const mz_uint32 decomp_flags);
@@ -0,0 +1,153 @@
+#include <esp_heap_caps.h>
+#include <esp32/rom/crc.h>
+#include <esp32/rom/miniz.h>
+#include <diskio_impl.h>
+#include <ff.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) return nullptr;
+    return malloc(size);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return caps & MALLOC_CAP_SPIRAM ? 0 : 180 * 1024;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return caps & MALLOC_CAP_SPIRAM ? 0 : 110 * 1024;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    return crc32(crc, buf, len);
+}
+
+static voidpf arenaAlloc(voidpf opaque, uInt items, uInt size) {
+    tinfl_decompressor* r = (tinfl_decompressor*)opaque;
+    size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+    if (r->arenaUsed + bytes > sizeof(r->arena)) return Z_NULL;
+    voidpf block = r->arena + r->arenaUsed;
+    r->arenaUsed += bytes;
+    return block;
+}
+
+static void arenaFree(voidpf, voidpf) {}
+
+// Runs zlib over [in, +inLength) into [out, +outLength), counting what it took and gave
+static int inflateSome(tinfl_decompressor* r, const mz_uint8* in, size_t& inLength, mz_uint8* out, size_t& outLength) {
+    r->stream.next_in = (Bytef*)in;
+    r->stream.avail_in = (uInt)inLength;
+    r->stream.next_out = out;
+    r->stream.avail_out = (uInt)outLength;
+    int result = inflate(&r->stream, Z_NO_FLUSH);
+    inLength -= r->stream.avail_in;
+    outLength -= r->stream.avail_out;
+    return result;
+}
+
+static voidpf heapAlloc(voidpf, uInt items, uInt size) {
+    return calloc(items, size);
+}
+
+static void heapFree(voidpf, voidpf block) {
+    free(block);
+}
+
+// How many of these bytes, which follow what zlib has taken, still belong to the deflate stream.
+// The rest (a gzip or zlib trailer) is for the caller. Found on a copy of the inflate state.
+static size_t deflateBytesNeeded(tinfl_decompressor* r, const mz_uint8* bytes, size_t length) {
+    z_stream copy;
+    r->stream.zalloc = heapAlloc; // The copy is not made in the arena
+    r->stream.zfree = heapFree;
+    int copied = inflateCopy(&copy, &r->stream);
+    r->stream.zalloc = arenaAlloc;
+    r->stream.zfree = arenaFree;
+    if (copied != Z_OK) return length;
+    static thread_local mz_uint8 scratch[64 * 1024];
+    copy.next_in = (Bytef*)bytes;
+    copy.avail_in = (uInt)length;
+    int result;
+    do {
+        copy.next_out = scratch;
+        copy.avail_out = sizeof(scratch);
+        result = inflate(&copy, Z_NO_FLUSH);
+    } while (result == Z_OK && copy.avail_in > 0);
+    size_t needed = result == Z_STREAM_END ? length - copy.avail_in : length;
+    inflateEnd(&copy);
+    return needed;
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                              mz_uint8* pOut_buf_start, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+    (void)pOut_buf_start; // zlib keeps its own window
+    if (r->m_state == 0) {
+        r->arenaUsed = 0;
+        r->lookaheadLength = 0;
+        r->stream = z_stream();
+        r->stream.zalloc = arenaAlloc;
+        r->stream.zfree = arenaFree;
+        r->stream.opaque = r;
+        int windowBits = decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER ? 15 : -15;
+        if (inflateInit2(&r->stream, windowBits) != Z_OK) return TINFL_STATUS_BAD_PARAM;
+        r->m_state = 1;
+    }
+    size_t outSize = *pOut_buf_size, produced = 0, consumed = 0;
+    int result = Z_OK;
+
+    // Bytes held back by the last call go first
+    if (r->lookaheadLength > 0) {
+        size_t taken = r->lookaheadLength;
+        produced = outSize;
+        result = inflateSome(r, r->lookahead, taken, pOut_buf_next, produced);
+        r->lookaheadLength -= taken;
+        memmove(r->lookahead, r->lookahead + taken, r->lookaheadLength);
+    }
+    if (r->lookaheadLength == 0 && (result == Z_OK || result == Z_BUF_ERROR) && produced < outSize) {
+        consumed = *pIn_buf_size;
+        size_t room = outSize - produced;
+        result = inflateSome(r, pIn_buf_next, consumed, pOut_buf_next + produced, room);
+        produced += room;
+        // tinfl pulls the next bytes into its bit buffer before it finds the output full, so it can
+        // take all of the deflate data and still have output to give: hold those bytes back likewise
+        size_t left = *pIn_buf_size - consumed;
+        if (result == Z_OK && produced == outSize && left > 0 && left <= sizeof(r->lookahead)) {
+            size_t needed = deflateBytesNeeded(r, pIn_buf_next + consumed, left);
+            memcpy(r->lookahead, pIn_buf_next + consumed, needed);
+            r->lookaheadLength = needed;
+            consumed += needed;
+        }
+    }
+    *pIn_buf_size = consumed;
+    *pOut_buf_size = produced;
+
+    if (result == Z_STREAM_END) return TINFL_STATUS_DONE;
+    if (result != Z_OK && result != Z_BUF_ERROR) {
+        bool badChecksum = result == Z_DATA_ERROR && r->stream.msg && strcmp(r->stream.msg, "incorrect data check") == 0;
+        return badChecksum ? TINFL_STATUS_ADLER32_MISMATCH : TINFL_STATUS_FAILED;
+    }
+    if (produced == outSize) return TINFL_STATUS_HAS_MORE_OUTPUT;
+    return decomp_flags & TINFL_FLAG_HAS_MORE_INPUT ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
+
+// No FATFS drives: the card backend never mounts on the host
+esp_err_t ff_diskio_get_drive(BYTE*) {
+    return ESP_FAIL;
+}
+
+DSTATUS disk_status(BYTE) {
+    return STA_NOINIT;
+}
+
+FRESULT f_opendir(FF_DIR*, const char*) {
+    return FR_NOT_READY;
+}
+
+FRESULT f_closedir(FF_DIR*) {
+    return FR_OK;
+}
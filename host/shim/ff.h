@@ -0,0 +1,32 @@
+#pragma once
+// Host build: the FatFs declarations the card backend uses. No volume is ever mounted, so the
+// functions fail; a FAT image backend would need the real FatFs.
+#include <stdint.h>
+#include "diskio.h"
+
+#define FF_MIN_SS 512
+#define FF_MAX_SS 4096
+
+typedef enum { FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE, FR_NO_PATH, FR_INVALID_NAME,
+               FR_DENIED, FR_EXIST, FR_INVALID_OBJECT, FR_WRITE_PROTECTED, FR_INVALID_DRIVE, FR_NOT_ENABLED,
+               FR_NO_FILESYSTEM } FRESULT;
+
+typedef struct {
+    uint8_t csize;      // Sectors per cluster
+    uint16_t ssize;     // Sector size
+    uint32_t n_fatent;
+    uint32_t free_clst;
+} FATFS;
+
+typedef struct {
+    FATFS* fs;
+    uint16_t id;
+} FFOBJID;
+
+typedef struct {
+    FFOBJID obj;
+    uint32_t dptr;
+} FF_DIR;
+
+FRESULT f_opendir(FF_DIR* dp, const char* path);
+FRESULT f_closedir(FF_DIR* dp);
@@ -0,0 +1,196 @@
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HostTask {
+    std::string name;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifyCount = 0;
+};
+
+struct HostQueue {
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<uint8_t> items;
+    size_t itemSize;
+    size_t length;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+struct HostSemaphore {
+    std::mutex lock;
+    std::condition_variable given;
+    UBaseType_t count;
+    UBaseType_t maxCount;
+};
+
+static thread_local HostTask* currentTask = nullptr;
+
+// Waits on `condition` until `ready` holds or `ticks` pass; portMAX_DELAY waits forever
+template <typename Predicate>
+static bool waitTicks(std::condition_variable& condition, std::unique_lock<std::mutex>& guard, TickType_t ticks, Predicate ready) {
+    if (ticks == portMAX_DELAY) {
+        condition.wait(guard, ready);
+        return true;
+    }
+    return condition.wait_for(guard, std::chrono::milliseconds(ticks), ready);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t, void* parameters,
+                                   UBaseType_t, TaskHandle_t* createdTask, BaseType_t) {
+    HostTask* task = new HostTask; // Tasks never end, so neither does this
+    task->name = name ? name : "";
+    if (createdTask) *createdTask = task;
+    std::thread([task, code, parameters]() {
+        currentTask = task;
+        code(parameters);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stackDepth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* createdTask) {
+    return xTaskCreatePinnedToCore(code, name, stackDepth, parameters, priority, createdTask, 0);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (!currentTask) currentTask = new HostTask; // main() or another thread the harness started
+    return currentTask;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t period) {
+    *previousWakeTime += period;
+    int32_t remaining = (int32_t)(*previousWakeTime - xTaskGetTickCount());
+    if (remaining > 0) delay(remaining);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    HostTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(task->lock);
+    waitTicks(task->notified, guard, ticksToWait, [task] { return task->notifyCount > 0; });
+    uint32_t count = task->notifyCount;
+    if (count > 0) task->notifyCount = clearCountOnExit ? 0 : count - 1;
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifyCount++;
+    task->notified.notify_all();
+    return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    if (length == 0 || itemSize == 0) return nullptr;
+    HostQueue* queue = new HostQueue;
+    queue->items.resize((size_t)length * itemSize);
+    queue->itemSize = itemSize;
+    queue->length = length;
+    return queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait, bool toFront) {
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!waitTicks(queue->notFull, guard, ticksToWait, [queue] { return queue->count < queue->length; })) return errQUEUE_FULL;
+    size_t slot;
+    if (toFront) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    memcpy(&queue->items[slot * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    queue->notEmpty.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!waitTicks(queue->notEmpty, guard, ticksToWait, [queue] { return queue->count > 0; })) return pdFALSE;
+    memcpy(buffer, &queue->items[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->notFull.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    memcpy(&queue->items[queue->head * queue->itemSize], item, queue->itemSize);
+    queue->count = 1;
+    queue->notEmpty.notify_one();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    HostSemaphore* semaphore = new HostSemaphore;
+    semaphore->count = initialCount;
+    semaphore->maxCount = maxCount;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> guard(semaphore->lock);
+    if (!waitTicks(semaphore->given, guard, ticksToWait, [semaphore] { return semaphore->count > 0; })) return pdFALSE;
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> guard(semaphore->lock);
+    if (semaphore->count >= semaphore->maxCount) return pdFALSE;
+    semaphore->count++;
+    semaphore->given.notify_one();
+    return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> guard(semaphore->lock);
+    return semaphore->count;
+}
@@ -0,0 +1,22 @@
+#pragma once
+// Host build: FreeRTOS tasks, queues and semaphores on std::thread. One tick is one millisecond.
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct HostTask* TaskHandle_t;
+typedef struct HostQueue* QueueHandle_t;
+typedef struct HostSemaphore* SemaphoreHandle_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY      ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+#define errQUEUE_FULL 0
@@ -0,0 +1,4 @@
+#pragma once
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
@@ -0,0 +1,9 @@
+#pragma once
+// Host build: the local stand-in servers ignore credentials, and certificates are not checked
+#define WIFI_SSID        "host"
+#define WIFI_PASSWORD    ""
+#define AWS_IOT_ENDPOINT "localhost"
+#define AWS_CERT_CA      ""
+#define AWS_CERT_CRT     ""
+#define AWS_CERT_PRIVATE ""
+#define THINGNAME        "host"
@@ -0,0 +1,287 @@
+#include "simulated_card.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+static const char* const opNames[SIM_OP_COUNT] = { "open", "read", "write", "flush", "close", "meta" };
+
+const char* simulatedOpName(SimulatedOp op) {
+    return opNames[op];
+}
+
+// Rough shapes for comparing settings, not measurements of any one card. "sdhc" is a class 10
+// card on the 25 MHz SPI bus, about 2.5 MB/s sequential writes with an occasional erase stall;
+// "slow" a worn or low-grade one that stalls often.
+bool loadLatencyProfile(const char* name, SimulatedCardOptions& options) {
+    LatencyModel* l = options.latency;
+    if (strcmp(name, "none") == 0) {
+        for (int op = 0; op < SIM_OP_COUNT; op++) l[op] = LatencyModel();
+    } else if (strcmp(name, "sdhc") == 0) {
+        l[SIM_OP_OPEN] = { 2000, 0, 1000, 0, 0, 0 };
+        l[SIM_OP_READ] = { 150, 330, 50, 0, 0, 0 };
+        l[SIM_OP_WRITE] = { 300, 380, 100, 0.5f, 20, 150 };
+        l[SIM_OP_FLUSH] = { 1500, 0, 500, 0.5f, 10, 80 };
+        l[SIM_OP_CLOSE] = { 2500, 0, 1000, 0, 0, 0 };
+        l[SIM_OP_META] = { 1500, 0, 500, 0, 0, 0 };
+    } else if (strcmp(name, "slow") == 0) {
+        l[SIM_OP_OPEN] = { 5000, 0, 3000, 0, 0, 0 };
+        l[SIM_OP_READ] = { 300, 500, 100, 0, 0, 0 };
+        l[SIM_OP_WRITE] = { 800, 700, 400, 3, 50, 400 };
+        l[SIM_OP_FLUSH] = { 4000, 0, 2000, 2, 50, 300 };
+        l[SIM_OP_CLOSE] = { 6000, 0, 3000, 0, 0, 0 };
+        l[SIM_OP_META] = { 4000, 0, 2000, 0, 0, 0 };
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseLatencySpec(const char* spec, SimulatedCardOptions& options) {
+    const char* equals = strchr(spec, '=');
+    if (!equals) return false;
+    int op = 0;
+    while (op < SIM_OP_COUNT && (strlen(opNames[op]) != (size_t)(equals - spec) || strncmp(spec, opNames[op], equals - spec) != 0)) op++;
+    if (op == SIM_OP_COUNT) return false;
+    LatencyModel model;
+    unsigned fixedUs = 0, perKiBUs = 0, jitterUs = 0, stallMinMs = 0, stallMaxMs = 0;
+    int fields = sscanf(equals + 1, "%u,%u,%u,%f,%u,%u", &fixedUs, &perKiBUs, &jitterUs, &model.stallPercent, &stallMinMs, &stallMaxMs);
+    if (fields < 1 || stallMaxMs < stallMinMs) return false;
+    model.fixedUs = fixedUs;
+    model.perKiBUs = perKiBUs;
+    model.jitterUs = jitterUs;
+    model.stallMinMs = stallMinMs;
+    model.stallMaxMs = stallMaxMs;
+    options.latency[op] = model;
+    return true;
+}
+
+// A file or directory of the simulated card, on a host file descriptor
+class SimulatedFile : public fs::FileImpl {
+public:
+    SimulatedFile(SimulatedCard& card, const char* path, int fd, DIR* directory)
+        : card(card), filePath(path), fd(fd), directory(directory) {
+        const char* slash = strrchr(filePath.c_str(), '/');
+        fileName = slash ? slash + 1 : filePath.c_str();
+    }
+    ~SimulatedFile() { close(); }
+
+    size_t write(const uint8_t* buf, size_t size) override {
+        if (fd < 0 || !card.isPresent()) return 0;
+        card.access(SIM_OP_WRITE, size);
+        if (card.takeWriteFailure()) return 0;
+        ssize_t n = ::write(fd, buf, size);
+        return n > 0 ? n : 0;
+    }
+
+    size_t read(uint8_t* buf, size_t size) override {
+        if (fd < 0 || !card.isPresent()) return 0;
+        card.access(SIM_OP_READ, size);
+        ssize_t n = ::read(fd, buf, size);
+        return n > 0 ? n : 0;
+    }
+
+    void flush() override {
+        if (fd >= 0 && card.isPresent()) card.access(SIM_OP_FLUSH, 0);
+    }
+
+    // Seeks stay in the cached FAT chain, so they cost nothing here
+    bool seek(uint32_t pos, fs::SeekMode mode) override {
+        static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+        return fd >= 0 && lseek(fd, pos, whence[mode]) >= 0;
+    }
+
+    size_t position() const override { return fd >= 0 ? lseek(fd, 0, SEEK_CUR) : 0; }
+
+    size_t size() const override {
+        struct stat st;
+        return fd >= 0 && fstat(fd, &st) == 0 ? st.st_size : 0;
+    }
+
+    void close() override {
+        if (fd >= 0) {
+            if (card.isPresent()) card.access(SIM_OP_CLOSE, 0);
+            ::close(fd);
+            fd = -1;
+        }
+        if (directory) {
+            closedir(directory);
+            directory = nullptr;
+        }
+    }
+
+    time_t getLastWrite() override {
+        struct stat st;
+        return stat(card.hostPath(filePath.c_str()).c_str(), &st) == 0 ? st.st_mtime : 0;
+    }
+
+    const char* path() const override { return filePath.c_str(); }
+    const char* name() const override { return fileName; }
+    bool isDirectory() override { return directory != nullptr; }
+
+    fs::FileImplPtr openNextFile(const char* mode) override;
+
+    void rewindDirectory() override {
+        if (directory) rewinddir(directory);
+    }
+
+    operator bool() override { return fd >= 0 || directory; }
+
+private:
+    SimulatedCard& card;
+    std::string filePath;
+    const char* fileName;
+    int fd;
+    DIR* directory;
+};
+
+class SimulatedFS : public fs::FSImpl {
+public:
+    SimulatedFS(SimulatedCard& card) : card(card) {}
+
+    fs::FileImplPtr open(const char* path, const char* mode, const bool create) override {
+        (void)create; // Like FATFS, the parent directory has to exist
+        if (!card.isPresent()) return fs::FileImplPtr();
+        card.access(SIM_OP_OPEN, 0);
+        std::string hostPath = card.hostPath(path);
+        struct stat st;
+        if (stat(hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            if (mode[0] != 'r') return fs::FileImplPtr();
+            DIR* directory = opendir(hostPath.c_str());
+            return directory ? std::make_shared<SimulatedFile>(card, path, -1, directory) : fs::FileImplPtr();
+        }
+        int flags;
+        bool update = strchr(mode, '+') != nullptr;
+        switch (mode[0]) {
+        case 'r': flags = update ? O_RDWR : O_RDONLY; break;
+        case 'w': flags = (update ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC; break;
+        case 'a': flags = (update ? O_RDWR : O_WRONLY) | O_CREAT; break; // FATFS only starts at the end
+        default: return fs::FileImplPtr();
+        }
+        int fd = ::open(hostPath.c_str(), flags, 0644);
+        if (fd < 0) return fs::FileImplPtr();
+        if (mode[0] == 'a') lseek(fd, 0, SEEK_END);
+        return std::make_shared<SimulatedFile>(card, path, fd, nullptr);
+    }
+
+    bool exists(const char* path) override {
+        if (!card.isPresent()) return false;
+        card.access(SIM_OP_META, 0);
+        struct stat st;
+        return stat(card.hostPath(path).c_str(), &st) == 0;
+    }
+
+    // FATFS refuses to rename over an existing file
+    bool rename(const char* pathFrom, const char* pathTo) override {
+        if (!card.isPresent()) return false;
+        card.access(SIM_OP_META, 0);
+        struct stat st;
+        if (stat(card.hostPath(pathTo).c_str(), &st) == 0) return false;
+        return ::rename(card.hostPath(pathFrom).c_str(), card.hostPath(pathTo).c_str()) == 0;
+    }
+
+    bool remove(const char* path) override { return metaCall(::unlink, path); }
+    bool rmdir(const char* path) override { return metaCall(::rmdir, path); }
+
+    bool mkdir(const char* path) override {
+        if (!card.isPresent()) return false;
+        card.access(SIM_OP_META, 0);
+        return ::mkdir(card.hostPath(path).c_str(), 0755) == 0;
+    }
+
+private:
+    bool metaCall(int (*call)(const char*), const char* path) {
+        if (!card.isPresent()) return false;
+        card.access(SIM_OP_META, 0);
+        return call(card.hostPath(path).c_str()) == 0;
+    }
+
+    SimulatedCard& card;
+};
+
+fs::FileImplPtr SimulatedFile::openNextFile(const char* mode) {
+    if (!directory || !card.isPresent()) return fs::FileImplPtr();
+    for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        std::string childPath = filePath == "/" ? "/" + std::string(entry->d_name) : filePath + "/" + entry->d_name;
+        return SimulatedFS(card).open(childPath.c_str(), mode, false);
+    }
+    return fs::FileImplPtr();
+}
+
+SimulatedCard::SimulatedCard(const char* rootDirectory, const SimulatedCardOptions& options)
+    : root(rootDirectory), options(options), filesystem(std::make_shared<SimulatedFS>(*this)), random(options.seed) {
+    while (!root.empty() && root.back() == '/') root.pop_back();
+}
+
+bool SimulatedCard::mount() {
+    if (!present) return false;
+    std::error_code error;
+    std::filesystem::create_directories(root, error);
+    return !error;
+}
+
+// True if this write should fail, as one does when the card times out
+bool SimulatedCard::takeWriteFailure() {
+    uint32_t remaining = writeFailures;
+    while (remaining > 0 && !writeFailures.compare_exchange_weak(remaining, remaining - 1)) {}
+    return remaining > 0;
+}
+
+bool SimulatedCard::truncate(const char* path, size_t length) {
+    if (!present) return false;
+    access(SIM_OP_META, 0);
+    return ::truncate(hostPath(path).c_str(), length) == 0;
+}
+
+// Whole clusters per file and one per directory, as FAT allocates them
+uint64_t SimulatedCard::usedBytes() {
+    uint64_t used = 0;
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        uint64_t size = it->is_directory(error) ? 1 : it->file_size(error);
+        if (!error) used += (size + options.clusterBytes - 1) / options.clusterBytes * options.clusterBytes;
+    }
+    return used;
+}
+
+void SimulatedCard::access(SimulatedOp op, size_t bytes) {
+    const LatencyModel& model = options.latency[op];
+    std::lock_guard<std::mutex> guard(bus);
+    uint64_t latencyUs = model.fixedUs + (uint64_t)model.perKiBUs * bytes / 1024;
+    if (model.jitterUs > 0) latencyUs += std::uniform_int_distribution<uint32_t>(0, model.jitterUs)(random);
+    bool stalled = model.stallPercent > 0 && std::uniform_real_distribution<float>(0, 100)(random) < model.stallPercent;
+    if (stalled) latencyUs += std::uniform_int_distribution<uint32_t>(model.stallMinMs, model.stallMaxMs)(random) * 1000ULL;
+
+    SimulatedOpStats& stat = stats[op];
+    stat.count++;
+    stat.stalls += stalled;
+    stat.totalUs += latencyUs;
+    stat.maxUs = std::max<uint32_t>(stat.maxUs, latencyUs);
+    if (latencyUs > 0) std::this_thread::sleep_for(std::chrono::microseconds(latencyUs));
+}
+
+void SimulatedCard::getStats(SimulatedOpStats copy[SIM_OP_COUNT]) {
+    std::lock_guard<std::mutex> guard(bus);
+    memcpy(copy, stats, sizeof(stats));
+}
+
+void SimulatedCard::resetStats() {
+    std::lock_guard<std::mutex> guard(bus);
+    memset(stats, 0, sizeof(stats));
+}
+
+void SimulatedCard::logStats() {
+    SimulatedOpStats copy[SIM_OP_COUNT];
+    getStats(copy);
+    for (int op = 0; op < SIM_OP_COUNT; op++) {
+        if (copy[op].count == 0) continue;
+        Serial.printf("[SimCard] %-5s %6lu ops, avg %5lu us, max %6lu us, %lu stalls\n", opNames[op],
+                      (unsigned long)copy[op].count, (unsigned long)(copy[op].totalUs / copy[op].count),
+                      (unsigned long)copy[op].maxUs, (unsigned long)copy[op].stalls);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+// Storage backend for the host build: a directory on the host stands in for the card, and every
+// file operation waits for a latency drawn from a per-operation model. Operations queue for one
+// simulated bus, as they do on the device's single SPI/SDMMC card.
+#include "app.h"
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+
+enum SimulatedOp {
+    SIM_OP_OPEN,
+    SIM_OP_READ,
+    SIM_OP_WRITE,
+    SIM_OP_FLUSH,
+    SIM_OP_CLOSE,
+    SIM_OP_META,    // exists, stat, rename, remove, mkdir, truncate, directory entries
+    SIM_OP_COUNT
+};
+
+// fixedUs + perKiBUs per KiB moved + uniform [0, jitterUs], and with stallPercent probability an
+// extra stall of stallMinMs-stallMaxMs, the way a card pauses for an erase or garbage collection
+struct LatencyModel {
+    uint32_t fixedUs = 0;
+    uint32_t perKiBUs = 0;
+    uint32_t jitterUs = 0;
+    float stallPercent = 0;
+    uint32_t stallMinMs = 0;
+    uint32_t stallMaxMs = 0;
+};
+
+struct SimulatedCardOptions {
+    LatencyModel latency[SIM_OP_COUNT];
+    uint64_t capacityBytes = 8ULL << 30;    // Reported only; writes are not refused when it is full
+    uint32_t clusterBytes = 32768;          // FAT32 default for 8-32 GB cards
+    uint32_t seed = 1;                      // Same seed, same latencies
+};
+
+struct SimulatedOpStats {
+    uint32_t count;
+    uint32_t stalls;
+    uint64_t totalUs;                       // Modelled latency, not the host's own time
+    uint32_t maxUs;
+};
+
+// "none", "sdhc" or "slow". False if there is no such profile.
+bool loadLatencyProfile(const char* name, SimulatedCardOptions& options);
+// "<op>=fixedUs,perKiBUs,jitterUs,stallPercent,stallMinMs,stallMaxMs" with op one of open, read,
+// write, flush, close, meta; trailing fields may be left out and are 0. False if malformed.
+bool parseLatencySpec(const char* spec, SimulatedCardOptions& options);
+const char* simulatedOpName(SimulatedOp op);
+
+class SimulatedCard : public StorageBackend {
+public:
+    SimulatedCard(const char* rootDirectory, const SimulatedCardOptions& options = SimulatedCardOptions());
+
+    const char* name() const override { return "simulated card"; }
+    bool mount() override;
+    bool isPresent() override { return present; }
+    fs::FS& files() override { return filesystem; }
+    bool truncate(const char* path, size_t length) override;
+    uint64_t totalBytes() override { return options.capacityBytes; }
+    uint64_t usedBytes() override;
+    uint32_t clusterSize() override { return options.clusterBytes; }
+
+    void setPresent(bool inserted) { present = inserted; } // Removal fails every later operation
+    void failWrites(uint32_t count) { writeFailures = count; } // The next `count` writes store nothing
+    bool takeWriteFailure();
+    std::string hostPath(const char* path) const { return root + path; }
+    void access(SimulatedOp op, size_t bytes); // Waits out one modelled operation on the bus
+    void getStats(SimulatedOpStats stats[SIM_OP_COUNT]);
+    void resetStats();
+    void logStats();
+
+private:
+    std::string root;
+    SimulatedCardOptions options;
+    fs::FS filesystem;
+    std::atomic<bool> present{true};
+    std::atomic<uint32_t> writeFailures{0};
+    std::mutex bus;
+    std::mt19937 random;
+    SimulatedOpStats stats[SIM_OP_COUNT] = {};
+};
@@ -0,0 +1,20 @@
+#pragma once
+// Minimal checks for the host tests: failures are counted and printed, and the run goes on
+#include <Arduino.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition) checkResult((condition), #condition, __FILE__, __LINE__)
+
+static inline void checkResult(bool passed, const char* condition, const char* file, int line) {
+    if (passed) return;
+    checkFailures++;
+    Serial.printf("[Test] FAILED %s:%d: %s\n", file, line, condition);
+}
+
+// Process exit code: 0 if every check passed
+static inline int checkSummary(const char* testName) {
+    if (checkFailures > 0) Serial.printf("[Test] %s: %d checks failed\n", testName, checkFailures);
+    else Serial.printf("[Test] %s: all checks passed\n", testName);
+    return checkFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+// streamDecode() fed the way streamDecodedBody() feeds it: slices of input into a small output
+// buffer, then empty calls once the body has ended until the output is no longer filled
+#include "app.h"
+#include "lz4_encoder.h"
+#include "check.h"
+#include <zlib.h>
+#include <vector>
+
+#define OUTPUT_SIZE 1024 // The firmware's chunk size
+
+// Compresses to about 1% with deflate: a long repeated phrase with a counter in it
+static std::string compressibleData(size_t size) {
+    std::string data;
+    char line[64];
+    for (int i = 0; data.size() < size; i++) {
+        snprintf(line, sizeof(line), "sample %d of the SP-404 bank, ", i / 50);
+        data += line;
+    }
+    data.resize(size);
+    return data;
+}
+
+// windowBits as for deflateInit2: 31 gzip, 15 zlib, -15 raw deflate
+static std::string deflateData(const std::string& data, int windowBits) {
+    z_stream stream = {};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 9, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// Decodes `encoded` in slices of sliceSize. False if the decoder failed or did not end cleanly.
+static bool decodeAll(uint8_t encoding, const std::string& encoded, size_t sliceSize, std::string& decoded) {
+    StreamDecoder* decoder = acquireStreamDecoder(encoding, 0);
+    if (!decoder) return false;
+    decoded.clear();
+    uint8_t output[OUTPUT_SIZE];
+    bool ok = true;
+    size_t pos = 0;
+    for (;;) {
+        size_t inLength = std::min(sliceSize, encoded.size() - pos);
+        bool inputEnds = pos + inLength == encoded.size();
+        size_t outLength = sizeof(output);
+        if (streamDecode(decoder, (const uint8_t*)encoded.data() + pos, inLength, output, outLength, inputEnds) == DECODE_ERROR) {
+            ok = false;
+            break;
+        }
+        pos += inLength;
+        decoded.append((const char*)output, outLength);
+        if (pos == encoded.size() && outLength < sizeof(output)) break; // Drained
+    }
+    ok = ok && streamDecoderAtEnd(decoder);
+    releaseStreamDecoder(decoder);
+    return ok;
+}
+
+static void checkRoundTrip(const char* name, uint8_t encoding, const std::string& data, const std::string& encoded) {
+    const size_t slices[] = { 1024, 7, encoded.size() };
+    for (size_t slice : slices) {
+        std::string decoded;
+        bool ok = decodeAll(encoding, encoded, slice, decoded);
+        if (!ok || decoded != data) {
+            Serial.printf("[Test] %s of %zu bytes in %zu byte slices: %s, %zu bytes out\n", name, data.size(), slice,
+                          ok ? "wrong output" : "failed", decoded.size());
+        }
+        CHECK(ok && decoded == data);
+    }
+}
+
+static void testInflate() {
+    // Around one and two windows, where the output wraps the window as the input runs out, and
+    // a deflate match (up to 258 bytes) past the wrap
+    std::vector<size_t> sizes = { 1, 1000, 100000 };
+    for (size_t base : { 32768, 65536 }) {
+        for (int delta = -2; delta <= 2; delta++) sizes.push_back(base + delta);
+        for (size_t delta : { 100, 257, 258, 259, 1000 }) sizes.push_back(base + delta);
+    }
+    for (size_t size : sizes) {
+        std::string data = compressibleData(size);
+        checkRoundTrip("gzip", CONTENT_ENCODING_GZIP, data, deflateData(data, 31));
+        checkRoundTrip("zlib", CONTENT_ENCODING_DEFLATE, data, deflateData(data, 15));
+        checkRoundTrip("raw deflate", CONTENT_ENCODING_DEFLATE, data, deflateData(data, -15));
+    }
+
+    // Concatenated gzip members
+    std::string first = compressibleData(40000), second = compressibleData(5000);
+    checkRoundTrip("gzip members", CONTENT_ENCODING_GZIP, first + second, deflateData(first, 31) + deflateData(second, 31));
+
+    // A truncated stream must not pass as complete
+    std::string data = compressibleData(50000);
+    std::string gzip = deflateData(data, 31);
+    std::string decoded;
+    CHECK(!decodeAll(CONTENT_ENCODING_GZIP, gzip.substr(0, gzip.size() - 4), 1024, decoded));
+    CHECK(!decodeAll(CONTENT_ENCODING_GZIP, gzip.substr(0, gzip.size() / 2), 1024, decoded));
+}
+
+static void testLz4() {
+    for (size_t size : { 1, 13, 65535, 65536, 65537, 300000 }) {
+        std::string data = compressibleData(size);
+        std::string frame = lz4CompressFrame((const uint8_t*)data.data(), data.size());
+        checkRoundTrip("lz4", CONTENT_ENCODING_LZ4, data, frame);
+    }
+    std::string data = compressibleData(100000);
+    std::string frame = lz4CompressFrame((const uint8_t*)data.data(), data.size());
+    CHECK(frame.size() < data.size() / 4);
+    std::string decoded;
+    CHECK(!decodeAll(CONTENT_ENCODING_LZ4, frame.substr(0, frame.size() - 4), 1024, decoded)); // No end mark
+}
+
+int main() {
+    testInflate();
+    testLz4();
+    return checkSummary("decoder");
+}
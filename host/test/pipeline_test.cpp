@@ -0,0 +1,173 @@
+// The download pipeline end to end: downloadTask fetches from the HTTPS stand-in, writeTask writes
+// to the simulated card, and what lands on the card must be what the server sent
+#include "https_stand_in.h"
+#include "simulated_card.h"
+#include "check.h"
+#include <unistd.h>
+#include <zlib.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#define FILE_COUNT  4
+#define WAIT_MS     60000
+
+static std::string objectBody(size_t size, uint32_t seed) {
+    std::string body(size, '\0');
+    std::mt19937 generator(seed);
+    for (size_t i = 0; i < size; i++) body[i] = (char)generator();
+    return body;
+}
+
+static std::string cardFile(SimulatedCard& card, int file) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/file_%d.bin", SAMPLE_DIRECTORY, file);
+    std::ifstream in(card.hostPath(path), std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// Enqueues files first..last and waits for the pipeline to finish them. False on timeout.
+// queryLength pads each URL with a query string, as long as a presigned URL's signature.
+static bool downloadFiles(int first, int last, PipelineStats& stats, size_t queryLength = 0) {
+    PipelineStats before;
+    getPipelineStats(before);
+    char url[128], key[32];
+    for (int i = first; i <= last; i++) {
+        snprintf(url, sizeof(url), "https://bench.example.com/bench/file_%d.bin", i);
+        snprintf(key, sizeof(key), "bench/%d", i);
+        std::string presigned = url;
+        if (queryLength > 0) presigned += "?X-Amz-Signature=" + std::string(queryLength, 'f');
+        enqueueDownloadUrl(presigned.c_str(), key);
+    }
+    unsigned long startMillis = millis();
+    do {
+        delay(20);
+        getPipelineStats(stats);
+    } while (stats.filesCompleted + stats.filesFailed - before.filesCompleted - before.filesFailed < (uint32_t)(last - first + 1) &&
+             millis() - startMillis < WAIT_MS);
+    delay(200); // Lets writeTask take the end markers still queued
+    getPipelineStats(stats);
+    return stats.filesCompleted + stats.filesFailed - before.filesCompleted - before.filesFailed == (uint32_t)(last - first + 1);
+}
+
+// Raw deflate, which some servers send as "deflate"
+static std::string rawDeflate(const std::string& data) {
+    z_stream stream = {};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+int main(int argc, char** argv) {
+    const char* root = argc > 1 ? argv[1] : "pipeline_test_card";
+    std::filesystem::remove_all(root);
+
+    // Around the 1 KiB chunk size, and one spanning many chunks, write batches and two 1 MiB segments
+    const size_t sizes[FILE_COUNT] = { 1, 1024, 3 * 1024 + 17, 1600000 };
+    std::string bodies[FILE_COUNT];
+    HttpsStandIn server;
+    char path[64];
+    for (int i = 1; i <= FILE_COUNT; i++) {
+        bodies[i - 1] = objectBody(sizes[i - 1], i);
+        snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, i);
+        server.addObject(path, bodies[i - 1]);
+    }
+    CHECK(server.start());
+    routeConnectionsToPort(server.port());
+
+    SimulatedCard card(root);
+    setStorageBackend(&card);
+    initFileDownloadHandler();
+    setupSD();
+    initSDPresence();
+
+    PipelineStats stats;
+    CHECK(downloadFiles(1, FILE_COUNT, stats));
+    CHECK(stats.filesFailed == 0 && stats.filesCompleted == FILE_COUNT);
+    size_t totalBytes = 0;
+    for (int i = 1; i <= FILE_COUNT; i++) {
+        CHECK(cardFile(card, i) == bodies[i - 1]);
+        totalBytes += sizes[i - 1];
+    }
+    CHECK(stats.bytesReceived == totalBytes && stats.bytesWritten == totalBytes);
+
+    // Every descriptor writeTask took went through sendChunk() and was timed there exactly once
+    LatencyHistogram latencies[STAGE_COUNT];
+    getStageLatencies(latencies);
+    CHECK(stats.chunkQueueSamples > FILE_COUNT);
+    CHECK(latencies[STAGE_QUEUE_SEND].samples == stats.chunkQueueSamples);
+    // One close per file; segmented builds also time each range request as a GET
+    CHECK(latencies[STAGE_HTTP_GET].samples >= FILE_COUNT && latencies[STAGE_SD_CLOSE].samples == FILE_COUNT);
+    CHECK(latencies[STAGE_SD_WRITE].samples > 0);
+
+    // A changed object is fetched again and replaces the copy on the card
+    bodies[1] = objectBody(sizes[1] + 100, 99);
+    snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, 2);
+    server.addObject(path, bodies[1]);
+    CHECK(downloadFiles(1, FILE_COUNT, stats));
+    CHECK(stats.filesFailed == 0);
+    for (int i = 1; i <= FILE_COUNT; i++) CHECK(cardFile(card, i) == bodies[i - 1]);
+    getStageLatencies(latencies);
+    CHECK(latencies[STAGE_QUEUE_SEND].samples == stats.chunkQueueSamples);
+
+    // A write the card refuses is retried, not counted as a completed file
+    bodies[2] = objectBody(sizes[2], 98);
+    snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, 3);
+    server.addObject(path, bodies[2]);
+    PipelineStats before;
+    getPipelineStats(before);
+    card.failWrites(2); // The preallocating write, then the first block of data
+    CHECK(downloadFiles(3, 3, stats));
+    CHECK(stats.filesCompleted == before.filesCompleted + 1 && stats.filesFailed == 0);
+    CHECK(cardFile(card, 3) == bodies[2]);
+
+    // Served compressed, stored decoded. Just over one decoder window, so output is still pending
+    // in the window when the last compressed byte has been read.
+    std::string plain;
+    while (plain.size() < 32770) plain += "kick snare hat ";
+    plain.resize(32770);
+    std::string deflated = rawDeflate(plain);
+    snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, FILE_COUNT + 1);
+    server.addObject(path, deflated, "deflate");
+    getPipelineStats(before);
+    CHECK(downloadFiles(FILE_COUNT + 1, FILE_COUNT + 1, stats));
+    CHECK(stats.filesCompleted == before.filesCompleted + 1 && stats.filesFailed == 0);
+    CHECK(cardFile(card, FILE_COUNT + 1) == plain);
+    CHECK(stats.bytesWritten - before.bytesWritten == plain.size());
+
+    // Presigned URLs of about 1.4 KB, more than the job arena holds at once, and slow to answer:
+    // enqueueDownloadUrl() waits for running jobs to free their records instead of dropping files
+    server.setFirstByteDelay(300);
+    const int presignedFirst = FILE_COUNT + 2, presignedLast = FILE_COUNT + 13;
+    for (int i = presignedFirst; i <= presignedLast; i++) {
+        snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, i);
+        server.addObject(path, objectBody(2000, i));
+    }
+    getPipelineStats(before);
+    CHECK(downloadFiles(presignedFirst, presignedLast, stats, 1400));
+    CHECK(stats.filesCompleted - before.filesCompleted == presignedLast - presignedFirst + 1 && stats.filesFailed == 0);
+    for (int i = presignedFirst; i <= presignedLast; i++) CHECK(cardFile(card, i) == objectBody(2000, i));
+
+    // An empty object replaces the large file through staging, and the free-space tracker sees
+    // the old version go
+    server.setFirstByteDelay(0);
+    snprintf(path, sizeof(path), BENCHMARK_PATH_FORMAT, FILE_COUNT);
+    server.addObject(path, "");
+    CHECK(downloadFiles(FILE_COUNT, FILE_COUNT, stats));
+    snprintf(path, sizeof(path), "%s/file_%d.bin", SAMPLE_DIRECTORY, FILE_COUNT);
+    CHECK(std::filesystem::exists(card.hostPath(path)) && cardFile(card, FILE_COUNT).empty());
+    CHECK(getAvailableSpace() == (card.totalBytes() - card.usedBytes()) / (1024 * 1024));
+
+    int result = checkSummary("pipeline");
+    fflush(stdout);
+    _exit(result); // The firmware's tasks never return
+}
@@ -0,0 +1,172 @@
+// The storage interface off-target: SimulatedCard under the firmware's card code (setupSD, the
+// free-space tracker, journals, the sample index) and its latency injection
+#include "simulated_card.h"
+#include "check.h"
+#include <filesystem>
+
+static void testFiles(SimulatedCard& card) {
+    File file = SD_CARD.open("/data.bin", FILE_WRITE);
+    CHECK(file);
+    uint8_t block[3000];
+    for (size_t i = 0; i < sizeof(block); i++) block[i] = (uint8_t)i;
+    CHECK(file.write(block, sizeof(block)) == sizeof(block));
+    CHECK(file.size() == sizeof(block));
+    file.close();
+
+    // "r+" keeps the contents and writes in place
+    file = SD_CARD.open("/data.bin", "r+");
+    CHECK(file.seek(1000));
+    CHECK(file.write(block, 10) == 10);
+    CHECK(file.seek(0));
+    uint8_t readBack[sizeof(block)];
+    CHECK(file.read(readBack, sizeof(readBack)) == sizeof(readBack));
+    CHECK(memcmp(readBack, block, 1000) == 0 && memcmp(readBack + 1000, block, 10) == 0);
+    file.close();
+
+    StorageStat st;
+    CHECK(storage().stat("/data.bin", st) && !st.isDirectory && st.size == sizeof(block) && st.mtime > 0);
+    CHECK(storage().truncate("/data.bin", 100));
+    CHECK(storage().stat("/data.bin", st) && st.size == 100);
+    CHECK(!storage().stat("/missing.bin", st));
+    CHECK(!SD_CARD.open("/missing.bin"));
+    CHECK(!SD_CARD.open("/no/such/dir.bin", FILE_WRITE));
+
+    // Like FATFS: no rename over an existing file
+    File other = SD_CARD.open("/other.bin", FILE_WRITE);
+    other.close();
+    CHECK(!SD_CARD.rename("/data.bin", "/other.bin"));
+    CHECK(SD_CARD.remove("/other.bin"));
+    CHECK(SD_CARD.rename("/data.bin", "/other.bin"));
+    CHECK(!SD_CARD.exists("/data.bin") && SD_CARD.exists("/other.bin"));
+
+    int entries = 0;
+    bool sawOther = false;
+    File root = SD_CARD.open("/");
+    CHECK(root && root.isDirectory());
+    for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+        entries++;
+        if (strcmp(entry.name(), "other.bin") == 0) sawOther = !entry.isDirectory() && entry.size() == 100;
+    }
+    CHECK(sawOther && entries >= 2); // The file and SPCLOUD_DIRECTORY at least
+    CHECK(SD_CARD.remove("/other.bin"));
+    CHECK(card.usedBytes() % card.clusterSize() == 0);
+}
+
+static void testJournal() {
+    DownloadJournal journal = {};
+    journal.expectedLength = 5000000;
+    journal.committedBytes = 1310720;
+    strcpy(journal.s3Key, "bank/a/kick.wav");
+    strcpy(journal.etag, "\"abc\"");
+    CHECK(saveDownloadJournal("kick.wav", journal));
+    DownloadJournal loaded;
+    CHECK(loadDownloadJournal("kick.wav", loaded));
+    CHECK(loaded.committedBytes == journal.committedBytes && strcmp(loaded.etag, journal.etag) == 0);
+    removeDownloadJournal("kick.wav");
+    CHECK(!loadDownloadJournal("kick.wav", loaded));
+}
+
+static void testSampleIndex(SimulatedCard& swappedIn) {
+    SampleRecord record = {};
+    strcpy(record.filename, "snare.wav");
+    record.size = 4096;
+    strcpy(record.etag, "\"e1\"");
+    recordSample(record);
+    SampleRecord found;
+    CHECK(findSampleRecord("snare.wav", found) && found.size == 4096 && strcmp(found.etag, "\"e1\"") == 0);
+    uint32_t files;
+    uint64_t bytes;
+    CHECK(sampleIndexTotals(files, bytes) && files == 1 && bytes == 4096);
+    removeSampleRecord("snare.wav");
+    CHECK(!findSampleRecord("snare.wav", found));
+    recordSample(record);
+
+    // Another card: setupSD() must drop the header loaded from the first one
+    setStorageBackend(&swappedIn);
+    setupSD();
+    CHECK(!findSampleRecord("snare.wav", found));
+    CHECK(sampleIndexTotals(files, bytes) && files == 0);
+}
+
+static void testFreeSpace(SimulatedCard& card) {
+    initSDPresence();
+    CHECK(isSDCardReady());
+    uint64_t freeMB = getAvailableSpace();
+    CHECK(freeMB == (card.totalBytes() - card.usedBytes()) / (1024 * 1024));
+    noteFileResized(0, 64 * 1024 * 1024);
+    CHECK(getAvailableSpace() == freeMB - 64);
+    noteFileResized(64 * 1024 * 1024, 0);
+    CHECK(getAvailableSpace() == freeMB);
+}
+
+static void testLatency(SimulatedCard& card) {
+    SimulatedCardOptions options;
+    CHECK(loadLatencyProfile("sdhc", options) && options.latency[SIM_OP_WRITE].perKiBUs > 0);
+    CHECK(!loadLatencyProfile("floppy", options));
+    CHECK(parseLatencySpec("write=2000,1000", options));
+    CHECK(options.latency[SIM_OP_WRITE].fixedUs == 2000 && options.latency[SIM_OP_WRITE].perKiBUs == 1000 &&
+          options.latency[SIM_OP_WRITE].stallPercent == 0);
+    CHECK(parseLatencySpec("close=100,0,50,2.5,10,20", options) && options.latency[SIM_OP_CLOSE].stallPercent == 2.5f);
+    CHECK(!parseLatencySpec("erase=1", options) && !parseLatencySpec("write", options) && !parseLatencySpec("flush=1,0,0,1,9,3", options));
+
+    // 2 ms + 1 ms/KiB: ten 2 KiB writes take 40 ms of modelled time, and at least that on the clock
+    SimulatedCard slowCard(card.hostPath("/slow").c_str(), options);
+    CHECK(slowCard.mount());
+    File file = slowCard.files().open("/timed.bin", FILE_WRITE);
+    uint8_t block[2048] = {};
+    unsigned long startMicros = micros();
+    for (int i = 0; i < 10; i++) file.write(block, sizeof(block));
+    unsigned long elapsedUs = micros() - startMicros;
+    file.close();
+    SimulatedOpStats stats[SIM_OP_COUNT];
+    slowCard.getStats(stats);
+    CHECK(stats[SIM_OP_WRITE].count == 10 && stats[SIM_OP_WRITE].totalUs == 40000 && stats[SIM_OP_WRITE].maxUs == 4000);
+    CHECK(elapsedUs >= 40000);
+    CHECK(stats[SIM_OP_OPEN].count == 1 && stats[SIM_OP_CLOSE].count == 1);
+
+    // Stalls come from the seeded generator: same seed, same stalls
+    SimulatedCardOptions stalling;
+    CHECK(parseLatencySpec("flush=0,0,0,50,1,2", stalling));
+    SimulatedCard first(card.hostPath("/stall1").c_str(), stalling), second(card.hostPath("/stall2").c_str(), stalling);
+    for (int i = 0; i < 20; i++) {
+        first.access(SIM_OP_FLUSH, 0);
+        second.access(SIM_OP_FLUSH, 0);
+    }
+    SimulatedOpStats firstStats[SIM_OP_COUNT], secondStats[SIM_OP_COUNT];
+    first.getStats(firstStats);
+    second.getStats(secondStats);
+    CHECK(firstStats[SIM_OP_FLUSH].stalls > 0 && firstStats[SIM_OP_FLUSH].stalls < 20);
+    CHECK(firstStats[SIM_OP_FLUSH].totalUs == secondStats[SIM_OP_FLUSH].totalUs);
+}
+
+static void testRemoval(SimulatedCard& card) {
+    File file = SD_CARD.open("/removed.bin", FILE_WRITE);
+    CHECK(file.write((const uint8_t*)"abc", 3) == 3);
+    card.setPresent(false);
+    CHECK(file.write((const uint8_t*)"abc", 3) == 0);
+    CHECK(!storage().probe() && !storage().mount());
+    CHECK(!SD_CARD.open("/removed.bin"));
+    file.close();
+    card.setPresent(true);
+    CHECK(storage().mount() && SD_CARD.exists("/removed.bin"));
+}
+
+int main(int argc, char** argv) {
+    const char* root = argc > 1 ? argv[1] : "storage_test_card";
+    std::filesystem::remove_all(root);
+    SimulatedCard card((std::string(root) + "/card").c_str());
+    SimulatedCard otherCard((std::string(root) + "/other").c_str());
+
+    setStorageBackend(&card);
+    initSampleIndex();
+    setupSD();
+    CHECK(SD_CARD.exists(SAMPLE_DIRECTORY) && SD_CARD.exists(SPCLOUD_DIRECTORY "/staging"));
+
+    testFiles(card);
+    testJournal();
+    testFreeSpace(card);
+    testLatency(card);
+    testRemoval(card);
+    testSampleIndex(otherCard);
+    return checkSummary("storage");
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Builds host/ once per firmware configuration platformio.ini ships, its envs and its commented
+# tuning flags, and runs the tests on each: most of these settings compile different code.
+#   host/test_variants.sh [build directory, default build-variants]
+set -e
+source_dir=$(dirname "$0")
+build_root=${1:-build-variants}
+
+variant() {
+    echo "[Variants] $1: ${2:-default settings}"
+    cmake -S "$source_dir" -B "$build_root/$1" -DFIRMWARE_DEFINES="$2" >/dev/null
+    cmake --build "$build_root/$1" -j"$(nproc)"
+    ctest --test-dir "$build_root/$1" --output-on-failure
+}
+
+variant default ""
+variant segmented "SEGMENTED_DOWNLOAD=1;SEGMENT_CONNECTIONS=2;SEGMENT_SIZE=1048576"
+variant sdmmc "SD_INTERFACE=1;SD_MMC_BUS_WIDTH=4"
+variant sd_bench "SD_WRITE_BENCHMARK=1;SD_SPI_FREQUENCY=25000000"
+variant bench "BENCHMARK_FILE_COUNT=8;BENCHMARK_ROUNDS=3"
+variant coalesce_16k "WRITE_COALESCE_SIZE=16384"
+variant one_worker "DOWNLOAD_WORKER_COUNT=1"
+variant shortest_first "SHORTEST_JOB_FIRST=1"
+variant fixed_pool "CHUNK_POOL_MAX_SIZE=6"
+echo "[Variants] All passed."
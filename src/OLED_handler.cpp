@@ -33,14 +33,16 @@ void showReadyToUpload(){
     display.display();
 }
 
-void showFileDownloadProgress(int currentFile, int percent) {
+void showFileDownloadProgress(int currentFile, int totalFiles, int percent, uint32_t bytesPerSecond, int32_t etaSeconds) {
     display.clearDisplay();
     display.setTextSize(1);
     display.setTextColor(SSD1306_WHITE);
     display.setCursor(0, 0);
-    display.printf("File %d", currentFile);
+    if (totalFiles > 0) display.printf("File %d/%d  %d%%", currentFile, totalFiles, percent);
+    else display.printf("File %d  %d%%", currentFile, percent);
     display.setCursor(0, 16);
-    display.printf("progress: %d%%", percent);
+    if (bytesPerSecond > 0) display.printf("%lu KB/s", (unsigned long)(bytesPerSecond / 1024));
+    if (etaSeconds >= 0) display.printf("  ETA %ld:%02ld", (long)(etaSeconds / 60), (long)(etaSeconds % 60));
     display.display();
 }
 
@@ -44,15 +44,72 @@ bool checkDeviceLinked(const String& deviceId); // Declare the new function
 void checkRegistrationStatus(const String& deviceId); 
 
 // ----------- SD CARD ---------
+#define SAMPLE_DIRECTORY "/ROLAND/SP-404SX/SMPL" // Where the SP-404SX loads samples from
+#define SPCLOUD_DIRECTORY "/SPCLOUD"             // Device-private state (journals etc.)
+#define SD_MAX_OPEN_FILES 5
+
 void setupSD();
 void publishSDStatus();
-uint64_t getAvailableSpace();
+uint64_t getAvailableSpace();     // MB, from the free-space tracker: no card access
+
+// Free-space tracker
+void initFreeSpace();             // After mounting: the one full count
+void noteFileResized(uint32_t oldSize, uint32_t newSize); // A file was created (0 -> n), grown, cut or deleted (n -> 0)
+void reconcileFreeSpace();        // From loop(); recounts now and then while the card is idle
+
+// Card presence: a card-detect interrupt when SD_DETECT_PIN is wired, else a periodic CMD13 probe
+enum SDCardEvent {
+  SD_EVENT_NONE,
+  SD_EVENT_INSERTED,  // Mounted and prepared
+  SD_EVENT_REMOVED,
+};
+
+void initSDPresence();          // After setupSD()
+SDCardEvent updateSDPresence(); // From loop(); remounts an inserted card and reports changes
+bool isSDCardReady();           // Cheap, for any task
+
+// ----------- STORAGE ---------
+// Card interface of the device backend, chosen at build time. SD_INTERFACE_SPI works with any
+// wiring; SD_INTERFACE_SDMMC uses the ESP32's SDMMC peripheral on its fixed pins (CLK 14, CMD 15,
+// D0 2, D1 4, D2 12, D3 13) with SD_MMC_BUS_WIDTH data lines.
+#define SD_INTERFACE_SPI   0
+#define SD_INTERFACE_SDMMC 1
+#ifndef SD_INTERFACE
+#define SD_INTERFACE SD_INTERFACE_SPI
+#endif
+
+struct StorageStat {
+  bool isDirectory;
+  size_t size;
+  time_t mtime;       // 0 if unknown
+};
+
+// Everything that touches the card goes through the active backend. Files are Arduino fs::Files,
+// so a backend over something other than the card (a FAT disk image, say) supplies an fs::FSImpl.
+class StorageBackend {
+public:
+  virtual ~StorageBackend() {}
+  virtual const char* name() const = 0;
+  virtual bool mount() = 0;              // (Re)mounts. Only call when nothing is open.
+  virtual bool isPresent() = 0;
+  virtual bool probe() { return isPresent(); } // Asks the medium itself; may cost a bus transaction
+  virtual fs::FS& files() = 0;           // open/read/write/seek/close, rename, remove, mkdir, openNextFile
+  virtual bool truncate(const char* path, size_t length) = 0;
+  virtual uint64_t totalBytes() = 0;
+  virtual uint64_t usedBytes() = 0;
+  virtual uint32_t clusterSize() { return 512; } // Allocation unit, for free-space accounting
+  bool stat(const char* path, StorageStat& st); // False if nothing is at `path`
+};
+
+StorageBackend& storage();
+void setStorageBackend(StorageBackend* backend); // Before setupSD(); the default is the card
+#define SD_CARD (storage().files())
 
 // ----------- OLED ------------
 void showDeviceLinked();
 void showSDRemoved();
 void showReadyToUpload();
-void showFileDownloadProgress(int currentFile, int percent);
+void showFileDownloadProgress(int currentFile, int totalFiles, int percent, uint32_t bytesPerSecond, int32_t etaSeconds);
 void showLinkCode(const String& regCode);
 void waitForDeviceLink(const String& regCode);
 
@@ -60,12 +117,201 @@ void waitForDeviceLink(const String& regCode);
 #define REG_CHECK_TOPIC_SUB "esp32/registration/status"
 #define AWS_IOT_PUBLISH_TOPIC "esp32/sd_status"
 #define AWS_IOT_SUBSCRIBE_TOPIC "esp32/commands"
+#define DOWNLOAD_STATUS_TOPIC "esp32/download_status"
 // ----------- SHARED FLAGS ----
 extern bool isDeviceRegistered;
 extern bool receivedRegStatus;
 
+// ----------- STREAM DECODER --
+// Inflates compressed downloads as they stream, with a bounded window held only while a job decodes
+#define CONTENT_ENCODING_IDENTITY 0
+#define CONTENT_ENCODING_GZIP     1
+#define CONTENT_ENCODING_DEFLATE  2 // zlib-wrapped, or raw deflate
+#define CONTENT_ENCODING_LZ4      3 // LZ4 frame format
+#define CONTENT_ENCODING_UNKNOWN  0xFF
+
+enum DecodeStatus { DECODE_MORE, DECODE_ERROR };
+struct StreamDecoder;
+
+uint8_t contentEncodingFromName(const char* name); // Content-Encoding header or batch "encoding" value
+StreamDecoder* acquireStreamDecoder(uint8_t encoding, uint32_t timeoutMs);
+void releaseStreamDecoder(StreamDecoder* decoder);
+// Decodes until the input runs out or the output is full. On return inLength and outLength
+// hold the bytes consumed and produced. inputEnds: `in` is the rest of the body; keep calling
+// with empty input until the output is no longer filled, to drain what is still buffered.
+DecodeStatus streamDecode(StreamDecoder* decoder, const uint8_t* in, size_t& inLength, uint8_t* out, size_t& outLength,
+                          bool inputEnds);
+bool streamDecoderAtEnd(const StreamDecoder* decoder); // True if the input may end here
+
 // File download handler API 
 void initFileDownloadHandler();
-void enqueueDownloadUrl(const char* url, const char* s3Key);
+void prepareStagingDirectory(); // After mounting the card: creates the sample directories, sweeps unfinished files
+bool isCardWriteInProgress();   // writeTask has a file open or a chunk in hand
+void dropOpenOutputFiles();     // On card removal: writeTask closes its files and discards the rest of their jobs
+#define JOB_PRIORITY_INTERACTIVE 0 // A user waiting on a sample; preempts bulk jobs
+#define JOB_PRIORITY_BULK        1 // Bank restores and syncs
+#define JOB_CONTAINER_NONE       0 // The object is one sample
+#define JOB_CONTAINER_TAR        1 // A tar bundle of samples, split into SAMPLE_DIRECTORY as it streams
+
+// Optional fields of a batch entry
+struct DownloadOptions {
+    uint8_t priority = JOB_PRIORITY_BULK;
+    int32_t sizeHint = -1;                        // Object size if the batch lists it
+    uint8_t encoding = CONTENT_ENCODING_IDENTITY;
+    uint8_t container = JOB_CONTAINER_NONE;
+    const char* etag = nullptr;                   // Current ETag of the object, lets an unchanged file skip the request
+    uint16_t batch = 0;                           // From beginDownloadBatch(), 0 for none
+};
+
+// Blocks while the scheduler is full, until a worker takes or finishes a job
+void enqueueDownloadUrl(const char* url, const char* s3Key, const DownloadOptions& options = DownloadOptions());
+
+// Cumulative pipeline counters since boot. They wrap, so compare two snapshots.
+struct PipelineStats {
+    uint32_t filesCompleted;
+    uint32_t filesFailed;
+    uint32_t bytesReceived;             // From the network, before decoding
+    uint32_t bytesWritten;              // To the card
+    uint32_t fileLatencyTotalMs;        // From a worker taking a completed file to its last byte
+    uint32_t fileLatencyMaxMs;
+    uint32_t chunkQueueSamples;         // Chunks received by writeTask
+    uint32_t chunkQueueOccupancyTotal;  // Chunk queue depth seen at each of them
+    uint32_t chunkQueueOccupancyMax;
+    uint32_t chunkQueueCapacity;
+    uint32_t chunkBuffers;              // Chunk buffers in the pool right now
+};
+
+void getPipelineStats(PipelineStats& stats);
+
+// ----------- STAGE LATENCY ---
+// Log-scale histograms of how long each pipeline stage takes, recorded lock-free from any task
+enum PipelineStage {
+    STAGE_DNS,          // Host lookups that missed the DNS cache
+    STAGE_TLS_CONNECT,  // TCP connect and TLS handshake of new connections
+    STAGE_HTTP_BEGIN,
+    STAGE_HTTP_GET,     // Request sent until the response headers are in
+    STAGE_STREAM_READ,  // Each read from the response body
+    STAGE_BUFFER_WAIT,  // Waiting for a free chunk buffer, i.e. for writeTask to catch up
+    STAGE_QUEUE_SEND,   // Handing a chunk to writeTask
+    STAGE_SD_OPEN,
+    STAGE_SD_WRITE,
+    STAGE_SD_CLOSE,
+    STAGE_COUNT
+};
+
+#define LATENCY_BUCKET_COUNT 24 // Bucket i holds samples of [2^i, 2^(i+1)) us; the last also holds anything slower
+
+struct LatencyHistogram {
+    uint32_t counts[LATENCY_BUCKET_COUNT];
+    uint32_t samples;
+    uint32_t maxUs;                     // Since boot
+};
+
+void recordStageLatency(PipelineStage stage, uint32_t micros);
+void getStageLatencies(LatencyHistogram histograms[STAGE_COUNT]); // Snapshot of the counters since boot
+uint32_t latencyPercentileUs(const LatencyHistogram& histogram, uint8_t percent); // Upper bound of the bucket holding it
+void logStageLatencies(const LatencyHistogram histograms[STAGE_COUNT]);
+const char* pipelineStageName(PipelineStage stage);
+
+// ----------- BENCHMARK -------
+// Built with -DPIPELINE_BENCHMARK=1 (see the esp32dev_bench env and host/bench), the firmware
+// downloads a fixed set of objects at boot and prints throughput, per-file latency and chunk queue occupancy
+#ifndef PIPELINE_BENCHMARK
+#define PIPELINE_BENCHMARK 0
+#endif
+#ifndef BENCHMARK_FILE_COUNT
+#define BENCHMARK_FILE_COUNT 8
+#endif
+#ifndef BENCHMARK_ROUNDS
+#define BENCHMARK_ROUNDS 3
+#endif
+
+void runPipelineBenchmark();
+
+// Built with -DSD_WRITE_BENCHMARK=1 (see the esp32dev_sd_bench envs), the firmware times sequential
+// writes of several block sizes on the configured card interface at boot
+#ifndef SD_WRITE_BENCHMARK
+#define SD_WRITE_BENCHMARK 0
+#endif
+
+void runSDWriteBenchmark();
+
+// ----------- DOWNLOAD BATCH --
+// Aggregate progress of one presigned-URL message, for the OLED and the download_status topic
+struct BatchProgress {
+    uint16_t id;
+    uint16_t totalFiles;
+    uint16_t filesDone;         // Finished, including skipped and failed ones
+    uint16_t filesFailed;
+    uint32_t totalBytes;        // Known sizes, plus an estimate for files not sized yet
+    uint32_t transferredBytes;
+    uint32_t bytesPerSecond;    // Moving average
+    int32_t etaSeconds;         // -1 until there is a rate to estimate from
+    uint32_t elapsedMs;
+};
+
+uint16_t beginDownloadBatch(uint16_t fileCount);
+// Called by the download workers as sizes become known and bytes arrive; deltas, may be negative
+void addBatchBytes(uint16_t batch, int32_t knownBytes, int32_t transferredBytes, uint16_t newlySizedFiles);
+void finishBatchFile(uint16_t batch, bool failed);
+void dropBatchFile(uint16_t batch); // A file of the batch that was never queued
+void sampleBatchRates();            // Called periodically to update the moving averages
+bool getBatchProgress(BatchProgress& progress); // Latest batch; false before the first one
+void publishBatchStatus();          // From the main loop; rate-limited
+
+// ----------- CONNECTION POOL -
+// Keep-alive HTTPS connections shared by the download tasks, reused while requests hit the same host
+class PooledClient : public WiFiClientSecure {
+public:
+    // Blocks until decrypted data can be read, the peer closes or timeoutMs passes. True if data is ready.
+    bool waitForData(uint32_t timeoutMs);
+};
+
+void initConnectionPool();
+PooledClient* acquireConnection(const char* url);
+void releaseConnection(PooledClient* client, bool keepAlive);
+void preconnectFor(const char* url); // Opens a connection for `url` in the background
+
+// ----------- DOWNLOAD JOURNAL
+#define S3_KEY_MAX_LENGTH 128
+#define ETAG_MAX_LENGTH   48
+
+// On-card record of a partially downloaded file, used to resume it with an HTTP Range request
+struct DownloadJournal {
+    uint32_t magic;
+    uint32_t expectedLength;    // Full object size
+    uint32_t committedBytes;    // Bytes flushed to the card, safe to resume after
+    char s3Key[S3_KEY_MAX_LENGTH];
+    char etag[ETAG_MAX_LENGTH];
+};
+
+bool loadDownloadJournal(const char* filename, DownloadJournal& journal);
+bool saveDownloadJournal(const char* filename, const DownloadJournal& journal);
+void removeDownloadJournal(const char* filename);
+
+// ----------- SAMPLE INDEX ----
+// On-card index of SAMPLE_DIRECTORY with one fixed-size record per sample, hashed by filename, so
+// sync decisions and inventory read one small file instead of walking the directory
+#define FILENAME_MAX_LENGTH 64
+#define SAMPLE_FLAG_CRC     0x01 // crc32 covers the whole file
+
+struct SampleRecord {
+    uint8_t state;                      // Managed by the index
+    uint8_t flags;                      // SAMPLE_FLAG_*
+    uint16_t reserved;
+    uint32_t size;
+    uint32_t mtime;                     // Seconds since the epoch, 0 if unknown
+    uint32_t crc32;
+    char filename[FILENAME_MAX_LENGTH]; // In SAMPLE_DIRECTORY
+    char s3Key[S3_KEY_MAX_LENGTH];      // Object it was downloaded from, empty if unknown
+    char etag[ETAG_MAX_LENGTH];         // ETag of that object when it was downloaded
+};
+
+void initSampleIndex();
+void resetSampleIndex(); // Call whenever a card is mounted
+bool findSampleRecord(const char* filename, SampleRecord& record);
+void recordSample(const SampleRecord& record); // Replaces any record for the same file
+void removeSampleRecord(const char* filename);
+bool sampleIndexTotals(uint32_t& fileCount, uint64_t& totalBytes);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "app.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+
+#define CONNECTION_POOL_SIZE      5      // One per concurrent download connection, plus a pre-connected one
+#define CONNECTION_IDLE_TIMEOUT_MS 15000 // S3 drops idle keep-alive connections after ~20 s
+#define DNS_CACHE_SIZE            4
+#define DNS_CACHE_TTL_MS          60000
+#define HOST_MAX_LENGTH           96
+#define HTTPS_PORT                443
+#define PRECONNECT_MIN_FREE_HEAP  (64 * 1024) // Leave room for the connections doing the downloads
+#define PRECONNECT_STACK_SIZE     8192
+
+// A TLS connection kept open between requests to the same host
+struct PooledConnection {
+    PooledClient client;
+    char host[HOST_MAX_LENGTH];
+    bool inUse;
+    bool preconnected;          // Opened ahead of time by preconnectTask, not yet used
+    unsigned long connectMillis; // How long opening it took
+    unsigned long lastUsed;
+};
+
+struct PreconnectRequest {
+    char host[HOST_MAX_LENGTH];
+    uint16_t port;
+};
+
+struct DnsCacheEntry {
+    char host[HOST_MAX_LENGTH];
+    IPAddress address;
+    unsigned long resolvedAt;
+};
+
+static PooledConnection connections[CONNECTION_POOL_SIZE];
+static DnsCacheEntry dnsCache[DNS_CACHE_SIZE];
+static SemaphoreHandle_t poolLock = NULL;
+static QueueHandle_t preconnectQueue = NULL;    // Holds one request; a newer one replaces it
+static TaskHandle_t preconnectTaskHandle = NULL;
+static uint32_t preconnectSavedMillis = 0;      // Connect time taken off the download path so far
+
+// Host part of "https://host[:port]/path?query"
+static bool hostFromUrl(const char* url, char* host, size_t hostSize, uint16_t& port) {
+    const char* start = strstr(url, "://");
+    start = start ? start + 3 : url;
+    size_t length = strcspn(start, ":/?");
+    if (length == 0 || length >= hostSize) return false;
+    memcpy(host, start, length);
+    host[length] = '\0';
+    port = start[length] == ':' ? (uint16_t)atoi(start + length + 1) : HTTPS_PORT;
+    return true;
+}
+
+// Cached address of `host`, resolving it when missing or older than DNS_CACHE_TTL_MS
+static bool resolveHost(const char* host, IPAddress& address) {
+    xSemaphoreTake(poolLock, portMAX_DELAY);
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        DnsCacheEntry& entry = dnsCache[i];
+        if (strcmp(entry.host, host) == 0 && millis() - entry.resolvedAt < DNS_CACHE_TTL_MS) {
+            address = entry.address;
+            xSemaphoreGive(poolLock);
+            return true;
+        }
+    }
+    xSemaphoreGive(poolLock);
+
+    // The lookup can take seconds, so it runs without the lock
+    uint32_t startUs = micros();
+    bool resolved = WiFi.hostByName(host, address);
+    recordStageLatency(STAGE_DNS, micros() - startUs);
+    if (!resolved) return false;
+
+    xSemaphoreTake(poolLock, portMAX_DELAY);
+    DnsCacheEntry* slot = &dnsCache[0];
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        DnsCacheEntry& entry = dnsCache[i];
+        if (strcmp(entry.host, host) == 0) {
+            slot = &entry;
+            break;
+        }
+        if (entry.resolvedAt < slot->resolvedAt) slot = &entry; // Oldest entry is replaced
+    }
+    strcpy(slot->host, host);
+    slot->address = address;
+    slot->resolvedAt = millis();
+    xSemaphoreGive(poolLock);
+    return true;
+}
+
+static void forgetHost(const char* host) {
+    xSemaphoreTake(poolLock, portMAX_DELAY);
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (strcmp(dnsCache[i].host, host) == 0) dnsCache[i].host[0] = '\0';
+    }
+    xSemaphoreGive(poolLock);
+}
+
+// Picks an entry for `host` and marks it in use. Prefers an idle open connection to the host,
+// then an unused entry, then closes the least recently used idle one unless `mayEvict` is false.
+// Sets `reused` if the entry is already connected. Call with poolLock held.
+static PooledConnection* claimEntry(const char* host, bool mayEvict, bool& reused) {
+    PooledConnection* chosen = nullptr;
+    reused = false;
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++) {
+        PooledConnection& entry = connections[i];
+        if (entry.inUse) continue;
+        // Each idle TLS session holds ~40 KB of heap, so stale ones are closed
+        if (entry.host[0] != '\0' && millis() - entry.lastUsed > CONNECTION_IDLE_TIMEOUT_MS) {
+            entry.client.stop();
+            entry.host[0] = '\0';
+            entry.preconnected = false;
+        }
+        if (entry.host[0] != '\0' && strcmp(entry.host, host) == 0 && entry.client.connected()) {
+            chosen = &entry;
+            reused = true;
+            break;
+        }
+        if (!chosen || (chosen->host[0] != '\0' && (entry.host[0] == '\0' || entry.lastUsed < chosen->lastUsed))) {
+            chosen = &entry;
+        }
+    }
+    if (!chosen || (!reused && !mayEvict && chosen->host[0] != '\0')) return nullptr;
+    chosen->inUse = true;
+    if (!reused) {
+        chosen->client.stop();
+        strcpy(chosen->host, host);
+        chosen->preconnected = false;
+    }
+    return chosen;
+}
+
+// Connects a claimed entry to the cached address of its host, skipping the DNS lookup; the name
+// still goes out for SNI and certificate checks. Returns false if the caller has to connect by name.
+static bool openEntry(PooledConnection& entry, uint16_t port) {
+    IPAddress address;
+    if (!resolveHost(entry.host, address)) return false;
+    uint32_t startUs = micros();
+    bool connected = entry.client.connect(address, port, entry.host, AWS_CERT_CA, NULL, NULL);
+    uint32_t elapsedUs = micros() - startUs;
+    recordStageLatency(STAGE_TLS_CONNECT, elapsedUs);
+    if (!connected) {
+        forgetHost(entry.host);
+        return false;
+    }
+    entry.connectMillis = elapsedUs / 1000;
+    return true;
+}
+
+// True if a connection to `host` is open or about to be handed back. Call with poolLock held.
+static bool hostHasConnection(const char* host) {
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++) {
+        const PooledConnection& entry = connections[i];
+        if (entry.host[0] != '\0' && strcmp(entry.host, host) == 0) return true;
+    }
+    return false;
+}
+
+// --- Preconnect Task (Core 0) ---
+// Opens the connection for the next queued job while the current one is still downloading,
+// so its DNS lookup, TCP connect and TLS handshake are off the download path.
+static void preconnectTask(void* pvParameters) {
+    PreconnectRequest request;
+    for (;;) {
+        if (xQueueReceive(preconnectQueue, &request, portMAX_DELAY) != pdTRUE) continue;
+        if (ESP.getFreeHeap() < PRECONNECT_MIN_FREE_HEAP) continue;
+
+        xSemaphoreTake(poolLock, portMAX_DELAY);
+        bool reused = false;
+        // Never closes a live connection to make room
+        PooledConnection* entry = hostHasConnection(request.host) ? nullptr : claimEntry(request.host, false, reused);
+        xSemaphoreGive(poolLock);
+        if (!entry) continue;
+
+        bool opened = openEntry(*entry, request.port);
+        if (opened) {
+            Serial.printf("[ConnPool] Pre-connected to %s in %lu ms\n", entry->host, entry->connectMillis);
+        }
+        xSemaphoreTake(poolLock, portMAX_DELAY);
+        entry->preconnected = opened;
+        xSemaphoreGive(poolLock);
+        releaseConnection(&entry->client, opened);
+    }
+}
+
+void initConnectionPool() {
+    if (!poolLock) poolLock = xSemaphoreCreateMutex();
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++) {
+        connections[i].client.setCACert(AWS_CERT_CA);
+    }
+    if (!preconnectQueue) preconnectQueue = xQueueCreate(1, sizeof(PreconnectRequest));
+    if (!preconnectTaskHandle && poolLock && preconnectQueue) {
+        xTaskCreatePinnedToCore(preconnectTask, "PreconnectTask", PRECONNECT_STACK_SIZE, NULL, 1, &preconnectTaskHandle, 0); // Core 0 for Network
+    }
+}
+
+PooledClient* acquireConnection(const char* url) {
+    char host[HOST_MAX_LENGTH];
+    uint16_t port;
+    if (!poolLock || !hostFromUrl(url, host, sizeof(host), port)) return nullptr;
+
+    xSemaphoreTake(poolLock, portMAX_DELAY);
+    bool reused = false;
+    PooledConnection* entry = claimEntry(host, true, reused);
+    bool preconnected = reused && entry->preconnected;
+    if (preconnected) {
+        entry->preconnected = false;
+        preconnectSavedMillis += entry->connectMillis;
+    }
+    xSemaphoreGive(poolLock);
+
+    if (!entry) {
+        Serial.println("[ConnPool] No free connection!");
+        return nullptr;
+    }
+    if (preconnected) {
+        Serial.printf("[ConnPool] Using pre-connected connection to %s: %lu ms saved (%lu ms in total)\n",
+                      host, entry->connectMillis, (unsigned long)preconnectSavedMillis);
+    } else if (reused) {
+        Serial.printf("[ConnPool] Reusing connection to %s\n", host);
+    } else if (openEntry(*entry, port)) {
+        // HTTPClient finds it connected; otherwise HTTPClient connects by name itself
+        Serial.printf("[ConnPool] New connection to %s in %lu ms\n", host, entry->connectMillis);
+    }
+    return &entry->client;
+}
+
+void releaseConnection(PooledClient* client, bool keepAlive) {
+    if (!client) return;
+    xSemaphoreTake(poolLock, portMAX_DELAY);
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++) {
+        PooledConnection& entry = connections[i];
+        if (&entry.client != client) continue;
+        // HTTPClient::end() already closed it if the server answered "Connection: close"
+        if (!keepAlive || !entry.client.connected()) {
+            entry.client.stop();
+            entry.host[0] = '\0';
+            entry.preconnected = false;
+        }
+        entry.inUse = false;
+        entry.lastUsed = millis();
+        break;
+    }
+    xSemaphoreGive(poolLock);
+}
+
+bool PooledClient::waitForData(uint32_t timeoutMs) {
+    unsigned long startMillis = millis();
+    for (;;) {
+        if (available() > 0) return true; // mbedTLS may already hold a decrypted record
+        if (!connected() || !sslclient || sslclient->socket < 0) return false;
+        unsigned long waited = millis() - startMillis;
+        if (waited >= timeoutMs) return false;
+
+        // Sleep in lwIP until the socket is readable, then let available() pull in the TLS record
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(sslclient->socket, &readSet);
+        struct timeval timeout;
+        timeout.tv_sec = (timeoutMs - waited) / 1000;
+        timeout.tv_usec = ((timeoutMs - waited) % 1000) * 1000;
+        if (select(sslclient->socket + 1, &readSet, NULL, NULL, &timeout) < 0) return false;
+    }
+}
+
+void preconnectFor(const char* url) {
+    PreconnectRequest request;
+    if (!preconnectQueue || !hostFromUrl(url, request.host, sizeof(request.host), request.port)) return;
+    xQueueOverwrite(preconnectQueue, &request);
+}
@@ -0,0 +1,159 @@
+#include "app.h"
+#include <algorithm>
+#include <atomic>
+
+#define BATCH_SLOTS             4     // Batches tracked at once; a newer one takes the oldest slot
+#define BATCH_RATE_SAMPLE_MS    1000
+#define BATCH_RATE_SMOOTHING    4     // Each sample moves the average 1/4 of the way
+#define BATCH_PUBLISH_INTERVAL_MS 5000
+
+// Counters are updated by the download workers and read by the progress task and the main loop.
+// Rate fields are only written by sampleBatchRates().
+struct BatchSlot {
+    std::atomic<uint16_t> id;               // 0 while unused
+    uint16_t totalFiles;
+    std::atomic<uint16_t> filesDone;
+    std::atomic<uint16_t> filesFailed;
+    std::atomic<uint16_t> sizedFiles;       // Files whose size is known
+    std::atomic<int32_t> knownBytes;        // Sum of the known sizes
+    std::atomic<int32_t> transferredBytes;
+    unsigned long startedAt;
+    std::atomic<uint32_t> elapsedMs;        // Set when the last file finishes
+    std::atomic<uint32_t> bytesPerSecond;
+    int32_t lastTransferred;
+    unsigned long lastSampleAt;
+};
+
+static BatchSlot batches[BATCH_SLOTS];
+static std::atomic<uint16_t> latestBatch(0);
+
+static BatchSlot* slotFor(uint16_t batch) {
+    if (batch == 0) return nullptr;
+    BatchSlot& slot = batches[batch % BATCH_SLOTS];
+    return slot.id == batch ? &slot : nullptr; // Updates for a batch that lost its slot are dropped
+}
+
+uint16_t beginDownloadBatch(uint16_t fileCount) {
+    uint16_t batch = latestBatch + 1;
+    if (batch == 0) batch = 1;
+    BatchSlot& slot = batches[batch % BATCH_SLOTS];
+    slot.id = 0;
+    slot.totalFiles = fileCount;
+    slot.filesDone = 0;
+    slot.filesFailed = 0;
+    slot.sizedFiles = 0;
+    slot.knownBytes = 0;
+    slot.transferredBytes = 0;
+    slot.startedAt = millis();
+    slot.elapsedMs = 0;
+    slot.bytesPerSecond = 0;
+    slot.lastTransferred = 0;
+    slot.lastSampleAt = slot.startedAt;
+    slot.id = batch;
+    latestBatch = batch;
+    Serial.printf("[Batch] Batch %u: %u file(s)\n", batch, fileCount);
+    return batch;
+}
+
+void addBatchBytes(uint16_t batch, int32_t knownBytes, int32_t transferredBytes, uint16_t newlySizedFiles) {
+    BatchSlot* slot = slotFor(batch);
+    if (!slot) return;
+    slot->knownBytes += knownBytes;
+    slot->transferredBytes += transferredBytes;
+    slot->sizedFiles += newlySizedFiles;
+}
+
+void finishBatchFile(uint16_t batch, bool failed) {
+    BatchSlot* slot = slotFor(batch);
+    if (!slot) return;
+    if (failed) slot->filesFailed++;
+    if (++slot->filesDone == slot->totalFiles) {
+        slot->elapsedMs = millis() - slot->startedAt;
+        Serial.printf("[Batch] Batch %u done: %u file(s), %u failed, %ld bytes in %lu ms\n", batch,
+                      slot->totalFiles, (unsigned)slot->filesFailed, (long)slot->transferredBytes,
+                      (unsigned long)slot->elapsedMs);
+    }
+}
+
+void dropBatchFile(uint16_t batch) {
+    addBatchBytes(batch, 0, 0, 1); // Nothing left to fetch for it
+    finishBatchFile(batch, true);
+}
+
+void sampleBatchRates() {
+    unsigned long now = millis();
+    for (int i = 0; i < BATCH_SLOTS; i++) {
+        BatchSlot& slot = batches[i];
+        if (slot.id == 0 || slot.filesDone == slot.totalFiles) continue;
+        unsigned long interval = now - slot.lastSampleAt;
+        if (interval < BATCH_RATE_SAMPLE_MS) continue;
+
+        int32_t transferred = slot.transferredBytes;
+        int32_t delta = transferred - slot.lastTransferred; // Negative after a retry rolls back
+        uint32_t sample = delta > 0 ? (uint64_t)delta * 1000 / interval : 0;
+        uint32_t rate = slot.bytesPerSecond;
+        slot.bytesPerSecond = rate == 0 ? sample : rate + ((int32_t)(sample - rate)) / BATCH_RATE_SMOOTHING;
+        slot.lastTransferred = transferred;
+        slot.lastSampleAt = now;
+    }
+}
+
+bool getBatchProgress(BatchProgress& progress) {
+    BatchSlot* slot = slotFor(latestBatch);
+    if (!slot) return false;
+    progress.id = slot->id;
+    progress.totalFiles = slot->totalFiles;
+    progress.filesDone = slot->filesDone;
+    progress.filesFailed = slot->filesFailed;
+    progress.transferredBytes = std::max<int32_t>(slot->transferredBytes, 0);
+
+    // Files not sized yet are assumed to be as large as the average sized one
+    int32_t known = std::max<int32_t>(slot->knownBytes, 0);
+    uint16_t sized = std::min<uint16_t>(slot->sizedFiles, progress.totalFiles);
+    uint32_t total = known;
+    if (sized > 0) total += (uint64_t)known / sized * (progress.totalFiles - sized);
+    progress.totalBytes = std::max(total, progress.transferredBytes);
+
+    bool finished = progress.filesDone >= progress.totalFiles;
+    progress.elapsedMs = finished ? slot->elapsedMs.load() : millis() - slot->startedAt;
+    progress.bytesPerSecond = slot->bytesPerSecond;
+    if (finished) {
+        progress.etaSeconds = 0;
+    } else if (progress.bytesPerSecond > 0 && sized > 0) {
+        progress.etaSeconds = (progress.totalBytes - progress.transferredBytes) / progress.bytesPerSecond;
+    } else {
+        progress.etaSeconds = -1;
+    }
+    return true;
+}
+
+// Publishes the latest batch every BATCH_PUBLISH_INTERVAL_MS while it runs, and once when it is done
+void publishBatchStatus() {
+    static uint16_t finalPublished = 0;
+    static unsigned long lastPublish = 0;
+    BatchProgress progress;
+    if (!getBatchProgress(progress) || progress.id == finalPublished) return;
+    bool finished = progress.filesDone >= progress.totalFiles;
+    if (!finished && millis() - lastPublish < BATCH_PUBLISH_INTERVAL_MS) return;
+    lastPublish = millis();
+
+    StaticJsonDocument<384> doc;
+    doc["batch"] = progress.id;
+    doc["state"] = finished ? "done" : "downloading";
+    doc["files"]["total"] = progress.totalFiles;
+    doc["files"]["done"] = progress.filesDone;
+    doc["files"]["failed"] = progress.filesFailed;
+    doc["bytes"]["total"] = progress.totalBytes;
+    doc["bytes"]["transferred"] = progress.transferredBytes;
+    doc["rate"] = progress.bytesPerSecond; // Bytes per second, moving average
+    doc["eta"] = progress.etaSeconds;
+    doc["elapsed"] = progress.elapsedMs;
+
+    char jsonBuffer[384];
+    serializeJson(doc, jsonBuffer);
+    if (client.publish(DOWNLOAD_STATUS_TOPIC, jsonBuffer)) {
+        if (finished) finalPublished = progress.id;
+    } else {
+        Serial.println("[Batch] Status publish failed");
+    }
+}
@@ -0,0 +1,51 @@
+#include "app.h"
+
+#define JOURNAL_DIRECTORY SPCLOUD_DIRECTORY "/journal"
+#define JOURNAL_MAGIC     0x4C4E524A // "JRNL"
+
+static void journalPath(const char* filename, char* path, size_t pathSize) {
+    snprintf(path, pathSize, "%s/%s.jnl", JOURNAL_DIRECTORY, filename);
+}
+
+bool loadDownloadJournal(const char* filename, DownloadJournal& journal) {
+    char path[128];
+    journalPath(filename, path, sizeof(path));
+    if (!SD_CARD.exists(path)) return false;
+
+    File journalFile = SD_CARD.open(path, FILE_READ);
+    if (!journalFile) return false;
+    size_t bytesRead = journalFile.read((uint8_t*)&journal, sizeof(journal));
+    journalFile.close();
+
+    if (bytesRead != sizeof(journal) || journal.magic != JOURNAL_MAGIC) {
+        Serial.printf("[Journal] Ignoring corrupt journal %s\n", path);
+        return false;
+    }
+    journal.s3Key[sizeof(journal.s3Key) - 1] = '\0';
+    journal.etag[sizeof(journal.etag) - 1] = '\0';
+    return true;
+}
+
+bool saveDownloadJournal(const char* filename, const DownloadJournal& journal) {
+    if (!SD_CARD.exists(JOURNAL_DIRECTORY)) {
+        SD_CARD.mkdir(SPCLOUD_DIRECTORY);
+        SD_CARD.mkdir(JOURNAL_DIRECTORY);
+    }
+
+    char path[128];
+    journalPath(filename, path, sizeof(path));
+    File journalFile = SD_CARD.open(path, FILE_WRITE);
+    if (!journalFile) return false;
+
+    DownloadJournal record = journal;
+    record.magic = JOURNAL_MAGIC;
+    size_t written = journalFile.write((const uint8_t*)&record, sizeof(record));
+    journalFile.close();
+    return written == sizeof(record);
+}
+
+void removeDownloadJournal(const char* filename) {
+    char path[128];
+    journalPath(filename, path, sizeof(path));
+    if (SD_CARD.exists(path)) SD_CARD.remove(path);
+}
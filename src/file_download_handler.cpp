@@ -2,45 +2,492 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_heap_caps.h>
+#include <esp32/rom/crc.h>
+#include <algorithm>
+#include <atomic>
 
 
-// --- Function to display download progress ---
-void showDownloadProgress(int currentFile, int percent) {
-    showFileDownloadProgress(currentFile, percent); 
-    char buf[40]; 
-    snprintf(buf, sizeof(buf), "File %d/%d", currentFile);
-    Serial.printf("[Progress] %s: %d%%\n", buf, percent);
+// --- Download progress ---
+// Workers only store the latest progress, packed as (file << 8) | percent so both change together.
+// progressTask samples it every PROGRESS_FRAME_MS and redraws when the shown values change,
+// which keeps I2C transfers and rendering out of the download loop.
+#define PROGRESS_FRAME_MS       200  // 5 Hz
+#define PROGRESS_STACK_SIZE     4096
+
+static std::atomic<uint32_t> downloadProgress(0);
+static TaskHandle_t progressTaskHandle = NULL;
+
+static inline void publishDownloadProgress(int currentFile, int percent) {
+    downloadProgress = ((uint32_t)currentFile << 8) | (uint8_t)percent;
+}
+
+// --- Progress Task (Core 1) ---
+void progressTask(void* pvParameters) {
+    uint32_t shown = 0;
+    BatchProgress shownBatch = {};
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(PROGRESS_FRAME_MS));
+        sampleBatchRates();
+        uint32_t progress = downloadProgress;
+        BatchProgress batch = {};
+        bool inBatch = getBatchProgress(batch) && batch.filesDone < batch.totalFiles;
+        bool batchChanged = inBatch && (batch.filesDone != shownBatch.filesDone ||
+                                        batch.etaSeconds != shownBatch.etaSeconds || batch.id != shownBatch.id);
+        if (progress == shown && !batchChanged) continue;
+        shown = progress;
+        if (inBatch) shownBatch = batch;
+
+        int currentFile = progress >> 8;
+        int percent = progress & 0xFF;
+        if (inBatch) {
+            // Within the batch: the next file to finish
+            showFileDownloadProgress(batch.filesDone + 1, batch.totalFiles, percent, batch.bytesPerSecond, batch.etaSeconds);
+            Serial.printf("[Progress] File %d/%d: %d%%, %lu/%lu bytes, ETA %ld s\n", batch.filesDone + 1, batch.totalFiles,
+                          percent, (unsigned long)batch.transferredBytes, (unsigned long)batch.totalBytes, (long)batch.etaSeconds);
+        } else {
+            showFileDownloadProgress(currentFile, 0, percent, 0, -1);
+            Serial.printf("[Progress] File %d: %d%%\n", currentFile, percent);
+        }
+    }
 }
 
 // --- Definitions ---
 
-#define URL_QUEUE_LENGTH        5
+#define URL_QUEUE_LENGTH        32   // Jobs waiting in the scheduler; their URLs share JOB_ARENA_SIZE
 #define URL_MAX_LENGTH          2048 
+#define JOB_ARENA_SIZE          10240 // Packed URL/key records of queued and running jobs; about 6 presigned URLs
 #define CHUNK_SIZE              1024 // Size of each data chunk read from HTTP stream
-#define CHUNK_QUEUE_LENGTH      2    // Number of chunks that can be buffered between download and write tasks
+#define CHUNK_QUEUE_LENGTH      2    // Chunks always buffered between download and write tasks; more are added while downloading
+#define SD_SECTOR_SIZE          512
+#define DOWNLOAD_MAX_ATTEMPTS   5      // Attempts per file, each resuming from the last committed byte
+#define DOWNLOAD_RETRY_DELAY_MS 2000   // Backoff step between attempts
+#define JOB_COMMIT_TIMEOUT_MS   30000  // Max wait for writeTask to commit an attempt
+#define STREAM_READ_TIMEOUT_MS  10000 // A body stalled this long is retried
+#define DECODER_WAIT_MS         60000 // A compressed job waits this long for another one to finish decoding
+#define JOURNAL_MIN_FILE_SIZE   (256 * 1024) // Smaller files just restart from zero
+#define JOURNAL_COMMIT_INTERVAL (128 * 1024) // Bytes written between journal updates
+// Files are written here and moved into SAMPLE_DIRECTORY once complete, so the SP-404SX never
+// sees a partial sample. A staged file with a journal is a download that can still resume.
+#define STAGING_DIRECTORY       SPCLOUD_DIRECTORY "/staging"
+
+// Download workers: up to DOWNLOAD_WORKER_COUNT tasks take scheduled jobs at once, so one file's
+// TLS handshake overlaps another's transfer. How many may run adapts to throughput and free heap.
+// Override with -DDOWNLOAD_WORKER_COUNT=<n>; 1 downloads strictly one file after another.
+#ifndef DOWNLOAD_WORKER_COUNT
+#define DOWNLOAD_WORKER_COUNT   3
+#endif
+#define WORKER_MIN_FREE_HEAP    (64 * 1024) // Extra workers only start a job above this; a TLS session takes ~45 KB
+#define WORKER_IDLE_POLL_MS     250    // How often a parked worker rechecks whether it may run
+#define CONCURRENCY_SAMPLE_MS   2000   // Throughput sampling period for adapting the worker count
+#define CONCURRENCY_HOLDOFF     5      // Samples to wait before retrying a worker that did not pay off
+// Each worker holds a job slot while downloading and takes a fresh one while writeTask drains the last.
+// writeTask keeps a file open per slot; the card is mounted with SD_MAX_OPEN_FILES and journals need one.
+#define JOB_SLOT_COUNT          (DOWNLOAD_WORKER_COUNT + 1)
+static_assert(DOWNLOAD_WORKER_COUNT >= 1 && JOB_SLOT_COUNT < SD_MAX_OPEN_FILES, "DOWNLOAD_WORKER_COUNT must be 1-3");
+
+// Bytes gathered by writeTask before each SD write. Override with -DWRITE_COALESCE_SIZE=<bytes>.
+#ifndef WRITE_COALESCE_SIZE
+#define WRITE_COALESCE_SIZE     8192
+#endif
+static_assert(WRITE_COALESCE_SIZE % SD_SECTOR_SIZE == 0, "WRITE_COALESCE_SIZE must be a multiple of the sector size");
+static_assert(WRITE_COALESCE_SIZE >= 4096 && WRITE_COALESCE_SIZE <= 32768, "WRITE_COALESCE_SIZE must be 4-32 KB");
+#define WRITE_COALESCE_BUDGET   (64 * 1024) // Static RAM for all write buffers: one per job slot and extra segment lane
+
+// Segmented mode: files larger than one segment are split into SEGMENT_SIZE byte ranges fetched
+// over SEGMENT_CONNECTIONS concurrent HTTPS connections and written at their offsets.
+// Enable with -DSEGMENTED_DOWNLOAD=1; each extra connection costs a task and a TLS session.
+#ifndef SEGMENTED_DOWNLOAD
+#define SEGMENTED_DOWNLOAD      0
+#endif
+#ifndef SEGMENT_SIZE
+#define SEGMENT_SIZE            (1024 * 1024)
+#endif
+#ifndef SEGMENT_CONNECTIONS
+#define SEGMENT_CONNECTIONS     2
+#endif
+
+#if SEGMENTED_DOWNLOAD
+#define DOWNLOAD_LANE_COUNT     SEGMENT_CONNECTIONS
+#else
+#define DOWNLOAD_LANE_COUNT     1
+#endif
+// Connections that fill chunk buffers: every worker plus the extra segment lanes
+#define DOWNLOAD_PRODUCER_COUNT (DOWNLOAD_WORKER_COUNT + DOWNLOAD_LANE_COUNT - 1)
+// Queued buffers plus one being filled per producer and the one being written
+#define CHUNK_POOL_SIZE         (CHUNK_QUEUE_LENGTH + DOWNLOAD_PRODUCER_COUNT + 1)
+
+// Extra chunk buffers, allocated while data arrives so an SD stall (FAT update, card garbage
+// collection) fills buffers instead of stalling the workers and draining the TCP window.
+// writeTask sizes the pool from the network rate and its SD write latency, and frees the extras when idle.
+#ifndef CHUNK_POOL_MAX_SIZE
+#define CHUNK_POOL_MAX_SIZE     64
+#endif
+#define CHUNK_POOL_HEAP_BUDGET  (24 * 1024) // Internal RAM for extra buffers
+#define CHUNK_POOL_PSRAM_BUDGET (64 * 1024) // Used instead when the board has PSRAM
+#define SD_LATENCY_WINDOW       64   // Recent SD block writes the latency percentile is taken over
+#define SD_LATENCY_PERCENTILE   95
+#define SD_STALL_MIN_MS         100  // Slack kept while downloading, even if the card has been fast so far
+#define SD_STALL_MAX_MS         300
+#define PIPELINE_SAMPLE_MS      500
+static_assert(DOWNLOAD_LANE_COUNT >= 1 && CHUNK_POOL_SIZE < 0xFF, "Invalid download lane configuration");
+static_assert(CHUNK_POOL_MAX_SIZE >= CHUNK_POOL_SIZE && CHUNK_POOL_MAX_SIZE < 0xFF, "CHUNK_POOL_MAX_SIZE must be at least CHUNK_POOL_SIZE and below 255");
+
+// Order of jobs within a priority class. Override with -DSHORTEST_JOB_FIRST=1 to run jobs with the
+// fewest known remaining bytes first; jobs of unknown size then run last, in arrival order.
+#ifndef SHORTEST_JOB_FIRST
+#define SHORTEST_JOB_FIRST      0
+#endif
+#define PREEMPT_GRACE_MS        250  // An interactive job waits this long for a free worker before preempting
+
+// --- Job Arena ---
+// URL, key and ETag of each job live in one variable-length record in jobArena, allocated as a ring:
+// new records go at the head, and freed records are reclaimed once everything older is freed too.
+// A record stays put until its job is done, so workers read its strings in place.
+struct ArenaRecord {
+    uint16_t size;              // Whole record including this header, a multiple of 4
+    uint8_t live;               // 0 once freed, or for the padding that fills the arena's end on wrap
+    uint8_t reserved;           // Padding only uses the first 4 bytes of the header
+    uint16_t keyOffset;         // Offset of the key from the start of the record
+    char etag[ETAG_MAX_LENGTH]; // From the batch, or set when a preempted job is requeued
+    char url[];                 // URL, then the key
+};
+// The longest record must fit an empty arena, or enqueueDownloadUrl() would wait for it forever
+static_assert(JOB_ARENA_SIZE >= sizeof(ArenaRecord) + URL_MAX_LENGTH + S3_KEY_MAX_LENGTH + 3 && JOB_ARENA_SIZE <= 0xFFFF,
+              "JOB_ARENA_SIZE must hold the longest URL and key, with 16-bit record offsets");
+
+static uint8_t jobArena[JOB_ARENA_SIZE] __attribute__((aligned(4)));
+static uint32_t arenaHead = 0;  // Where the next record goes
+static uint32_t arenaTail = 0;  // Oldest record not yet reclaimed
+static uint32_t arenaUsed = 0;
+
+static inline ArenaRecord* arenaRecord(uint16_t offset) {
+    return (ArenaRecord*)&jobArena[offset];
+}
+
+// Returns the offset of a new record of `size` bytes, or -1 if the arena is full. Call with schedulerLock held.
+static int32_t arenaAllocate(uint32_t size) {
+    if (arenaUsed == 0) arenaHead = arenaTail = 0;
+    if (arenaHead >= arenaTail && arenaUsed < JOB_ARENA_SIZE) {
+        // Records span [tail, head): free space is after head, then before tail
+        if (size > JOB_ARENA_SIZE - arenaHead) {
+            if (size > arenaTail) return -1;
+            if (arenaHead < JOB_ARENA_SIZE) { // Pad to the end so the next record starts at 0
+                ArenaRecord* padding = arenaRecord(arenaHead);
+                padding->size = JOB_ARENA_SIZE - arenaHead;
+                padding->live = 0;
+                arenaUsed += padding->size;
+            }
+            arenaHead = 0;
+        }
+    } else if (arenaTail - arenaHead < size || arenaUsed == JOB_ARENA_SIZE) {
+        return -1; // Wrapped: the only free space is [head, tail)
+    }
+    int32_t offset = arenaHead;
+    arenaHead += size;
+    if (arenaHead == JOB_ARENA_SIZE) arenaHead = 0;
+    arenaUsed += size;
+    return offset;
+}
 
-// --- Queues and Task Handles ---
-static QueueHandle_t urlQueue = NULL;
-static TaskHandle_t downloadTaskHandle = NULL;
+// Call with schedulerLock held
+static void arenaFree(uint16_t offset) {
+    arenaRecord(offset)->live = 0;
+    while (arenaUsed > 0 && !arenaRecord(arenaTail)->live) {
+        uint16_t size = arenaRecord(arenaTail)->size;
+        arenaUsed -= size;
+        arenaTail += size;
+        if (arenaTail == JOB_ARENA_SIZE) arenaTail = 0;
+    }
+}
+
+// --- Job Scheduler and Task Handles ---
+// Scheduler entry for a job; its strings are in the arena record
+struct DownloadRequest {
+    uint16_t record;            // Offset of the job's ArenaRecord
+    uint8_t priority;           // JOB_PRIORITY_*
+    uint8_t encoding;           // CONTENT_ENCODING_* from the batch entry
+    uint8_t container;          // JOB_CONTAINER_*
+    int32_t sizeHint;           // Size from the batch entry, -1 if unknown
+    uint32_t sequence;          // Arrival order
+    unsigned long enqueuedAt;
+    // Where a preempted job continues; resumeOffset is 0 for a job that has not started
+    uint32_t resumeOffset;
+    int32_t expectedLength;
+    // This job's share of its batch's totals, carried along when it is preempted
+    uint16_t batch;
+    bool batchSized;
+    uint32_t batchKnownBytes;
+    uint32_t batchTransferredBytes;
+};
+
+static inline const char* jobUrl(const DownloadRequest& request) { return arenaRecord(request.record)->url; }
+static inline const char* jobKey(const DownloadRequest& request) {
+    return (const char*)arenaRecord(request.record) + arenaRecord(request.record)->keyOffset;
+}
+
+// Moves the job's share of its batch to `known` total and `transferred` bytes
+static void updateBatchShare(DownloadRequest& request, uint32_t known, uint32_t transferred, bool sized) {
+    if (request.batch == 0) return;
+    addBatchBytes(request.batch, (int32_t)(known - request.batchKnownBytes),
+                  (int32_t)(transferred - request.batchTransferredBytes), sized && !request.batchSized ? 1 : 0);
+    request.batchKnownBytes = known;
+    request.batchTransferredBytes = transferred;
+    request.batchSized = request.batchSized || sized;
+}
+
+// Waiting jobs. Workers take the job that runsBefore() all others. Guarded by schedulerLock.
+static DownloadRequest pendingJobs[URL_QUEUE_LENGTH];
+static bool pendingUsed[URL_QUEUE_LENGTH];
+static uint32_t nextSequence = 0;
+static int preemptionsInFlight = 0;          // Bulk jobs yielding to a waiting interactive job
+static std::atomic<int> interactivePending(0);
+static SemaphoreHandle_t schedulerLock = NULL;
+static SemaphoreHandle_t jobsPending = NULL;  // Counts used entries
+static SemaphoreHandle_t freeEntries = NULL;  // Counts unused entries, including reserved ones
+
+static TaskHandle_t downloadTaskHandles[DOWNLOAD_WORKER_COUNT] = {};
 static TaskHandle_t writeTaskHandle = NULL;
 
-struct FileChunk {
-    uint8_t data[CHUNK_SIZE];
-    size_t length;
-    bool isLast;        // True if this is the last marker chunk for a file
-    char filename[64];  // Set in the first data chunk of a file, or in the 'isLast' marker for 0-byte files
+// --- Chunk Buffer Pool ---
+// Chunk data never travels through a queue. A download worker takes a free buffer index from
+// freeChunkQueue, reads the HTTP stream straight into it and hands a ChunkDescriptor to
+// writeTask, which writes the buffer to SD and returns the index to freeChunkQueue.
+// Descriptors of concurrent jobs interleave in chunkQueue; writeTask tells them apart by job id.
+#define CHUNK_FLAG_FIRST        0x01 // First data chunk of a job: open the target file
+#define CHUNK_FLAG_LAST         0x02 // End-of-job marker, carries no buffer
+#define CHUNK_FLAG_FAILED       0x04 // Set on the end-of-job marker when the download did not complete
+#define CHUNK_FLAG_SEGMENT      0x08 // The lane starts a new byte range at `offset`, carries no buffer
+#define CHUNK_NO_BUFFER         0xFF
+
+struct ChunkDescriptor {
+    uint8_t bufferIndex;    // Index into chunkPool, or CHUNK_NO_BUFFER for markers
+    uint8_t flags;          // CHUNK_FLAG_*
+    uint8_t lane;           // Download connection that produced the chunk, selects the write buffer
+    uint16_t jobId;         // Index into jobSlots
+    uint16_t length;
+    uint32_t offset;        // File offset of the data
+};
+
+// Per-job metadata, written by the worker before the job's first descriptor is queued. A worker
+// takes a slot from freeJobQueue per job and returns it once writeTask has committed the last attempt.
+struct JobInfo {
+    TaskHandle_t owner;               // Worker downloading the job, notified when an attempt is committed
+    DownloadRequest* request;         // The owner's copy of the request, for batch progress
+    char filename[FILENAME_MAX_LENGTH];
+    char s3Key[S3_KEY_MAX_LENGTH];
+    char etag[ETAG_MAX_LENGTH];
+    char cachedEtag[ETAG_MAX_LENGTH]; // ETag of the copy already on the card, sent as If-None-Match
+    uint8_t priority;                 // JOB_PRIORITY_*
+    uint8_t encoding;                 // CONTENT_ENCODING_* of the object
+    uint8_t container;                // JOB_CONTAINER_*
+    int32_t expectedLength;           // Full object size, -1 if unknown
+    uint32_t startOffset;             // File offset of the current attempt's first data chunk
+    volatile uint32_t committedBytes; // Set by writeTask when it commits a failed attempt
+    volatile bool writeFailed;        // Set by writeTask when the card did not take the attempt's data
+    std::atomic<uint32_t> receivedBytes; // Bytes received by all lanes during the current attempt
 };
+
+static uint8_t chunkBaseBuffers[CHUNK_POOL_SIZE][CHUNK_SIZE];
+static uint8_t* chunkPool[CHUNK_POOL_MAX_SIZE]; // Base buffers, then extra ones (NULL while not allocated)
+static SemaphoreHandle_t chunkPoolLock = NULL;  // Guards allocating and freeing extra buffers
+static std::atomic<int> chunkBuffersAllocated(CHUNK_POOL_SIZE);
+static std::atomic<int> chunkPoolTarget(CHUNK_POOL_SIZE);
+static int chunkPoolLimit = CHUNK_POOL_SIZE;    // From the heap budget, set at init
+static bool chunkPoolUsesPsram = false;
+static QueueHandle_t freeChunkQueue = NULL;
 static QueueHandle_t chunkQueue = NULL;
+static QueueHandle_t freeJobQueue = NULL;
+static JobInfo jobSlots[JOB_SLOT_COUNT];
+
+static inline JobInfo& jobInfoFor(uint16_t jobId) {
+    return jobSlots[jobId];
+}
+
+// Compressed data and bundles only make sense read from byte 0, so those jobs never resume
+// with a Range request, are never segmented and always restart from scratch
+static inline bool jobIsResumable(const JobInfo& job) {
+    return job.encoding == CONTENT_ENCODING_IDENTITY && job.container == JOB_CONTAINER_NONE;
+}
+
+static void releaseJobSlot(uint16_t jobId) {
+    uint8_t slot = (uint8_t)jobId;
+    xQueueSend(freeJobQueue, &slot, 0); // Never blocks: the queue holds every slot
+}
+
+// Frees an extra buffer instead of pooling it while the pool is above target
+static bool trimChunkBuffer(uint8_t bufferIndex) {
+#if CHUNK_POOL_MAX_SIZE > CHUNK_POOL_SIZE
+    if (bufferIndex < CHUNK_POOL_SIZE || chunkBuffersAllocated <= chunkPoolTarget) return false;
+    xSemaphoreTake(chunkPoolLock, portMAX_DELAY);
+    heap_caps_free(chunkPool[bufferIndex]);
+    chunkPool[bufferIndex] = NULL;
+    chunkBuffersAllocated--;
+    xSemaphoreGive(chunkPoolLock);
+    return true;
+#else
+    return false; // No extra buffers: the pool is fixed at CHUNK_POOL_SIZE
+#endif
+}
+
+static void releaseChunkBuffer(const ChunkDescriptor& chunk) {
+    if (chunk.bufferIndex != CHUNK_NO_BUFFER && !trimChunkBuffer(chunk.bufferIndex)) {
+        xQueueSend(freeChunkQueue, &chunk.bufferIndex, 0); // Never blocks: the queue holds every index
+    }
+}
+
+// Allocates an extra buffer if the pool is below target. PSRAM is used when present, since
+// chunks are only copied out of it; internal RAM only while the workers' headroom stays intact.
+static bool growChunkPool(uint8_t& bufferIndex) {
+#if CHUNK_POOL_MAX_SIZE > CHUNK_POOL_SIZE
+    if (chunkBuffersAllocated >= chunkPoolTarget) return false;
+    bool grown = false;
+    xSemaphoreTake(chunkPoolLock, portMAX_DELAY);
+    for (int i = CHUNK_POOL_SIZE; i < CHUNK_POOL_MAX_SIZE && chunkBuffersAllocated < chunkPoolTarget; i++) {
+        if (chunkPool[i]) continue;
+        uint8_t* buffer = NULL;
+        if (chunkPoolUsesPsram) {
+            buffer = (uint8_t*)heap_caps_malloc(CHUNK_SIZE, MALLOC_CAP_SPIRAM);
+        } else if (ESP.getFreeHeap() >= WORKER_MIN_FREE_HEAP + CHUNK_SIZE) {
+            buffer = (uint8_t*)heap_caps_malloc(CHUNK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (buffer) {
+            chunkPool[i] = buffer;
+            chunkBuffersAllocated++;
+            bufferIndex = i;
+            grown = true;
+        }
+        break;
+    }
+    xSemaphoreGive(chunkPoolLock);
+    return grown;
+#else
+    return false;
+#endif
+}
+
+// Takes a free buffer, growing the pool before waiting on writeTask
+static bool takeChunkBuffer(uint8_t& bufferIndex) {
+    if (xQueueReceive(freeChunkQueue, &bufferIndex, 0) == pdTRUE) return true;
+    if (growChunkPool(bufferIndex)) return true;
+    uint32_t startUs = micros();
+    bool taken = xQueueReceive(freeChunkQueue, &bufferIndex, pdMS_TO_TICKS(5000)) == pdTRUE;
+    recordStageLatency(STAGE_BUFFER_WAIT, micros() - startUs); // Only waits are worth a sample
+    return taken;
+}
+
+// Hands a descriptor to writeTask
+static bool sendChunk(const ChunkDescriptor& chunk) {
+    uint32_t startUs = micros();
+    bool sent = xQueueSend(chunkQueue, &chunk, pdMS_TO_TICKS(5000)) == pdPASS;
+    recordStageLatency(STAGE_QUEUE_SEND, micros() - startUs);
+    return sent;
+}
 
 // --- Forward Declarations ---
 void downloadTask(void* pvParameters);
 void writeTask(void* pvParameters);
+#if SEGMENTED_DOWNLOAD
+void segmentTask(void* pvParameters);
+static TaskHandle_t segmentTaskHandles[SEGMENT_CONNECTIONS - 1] = {};
+static SemaphoreHandle_t segmentLock = NULL;        // Orders segment hand-out and SEGMENT markers
+static SemaphoreHandle_t segmentTasksIdle = NULL;   // Given by each segmentTask when it runs out of work
+static SemaphoreHandle_t segmentLanesOwner = NULL;  // Held by the worker whose job the segment lanes serve
+#endif
+
+// --- Adaptive Concurrency ---
+// Worker 0 always runs; workers 1..N-1 only take jobs while activeWorkerLimit allows it. Every
+// CONCURRENCY_SAMPLE_MS the aggregate download rate is measured. With jobs waiting one more
+// worker is allowed, and it is kept only if the rate rose by 10%. Low free heap takes a worker away.
+static std::atomic<uint32_t> totalBytesReceived(0);
+static std::atomic<uint8_t> activeWorkerLimit(1);
+static std::atomic<int> fileDownloadAttemptCounter(0);
+static SemaphoreHandle_t concurrencyLock = NULL;
+
+// --- Pipeline Statistics ---
+// Cumulative counters behind getPipelineStats(). They wrap; readers take differences.
+static std::atomic<uint32_t> filesCompleted(0);
+static std::atomic<uint32_t> filesFailed(0);
+static std::atomic<uint32_t> totalBytesWritten(0);
+static std::atomic<uint32_t> fileLatencyTotalMs(0);
+static std::atomic<uint32_t> fileLatencyMaxMs(0);
+static std::atomic<uint32_t> chunkQueueSamples(0);        // Updated by writeTask only
+static std::atomic<uint32_t> chunkQueueOccupancyTotal(0);
+static std::atomic<uint32_t> chunkQueueOccupancyMax(0);
+
+static void raiseToAtLeast(std::atomic<uint32_t>& maximum, uint32_t value) {
+    uint32_t current = maximum;
+    while (value > current && !maximum.compare_exchange_weak(current, value)) {}
+}
+
+void getPipelineStats(PipelineStats& stats) {
+    stats.filesCompleted = filesCompleted;
+    stats.filesFailed = filesFailed;
+    stats.bytesReceived = totalBytesReceived;
+    stats.bytesWritten = totalBytesWritten;
+    stats.fileLatencyTotalMs = fileLatencyTotalMs;
+    stats.fileLatencyMaxMs = fileLatencyMaxMs;
+    stats.chunkQueueSamples = chunkQueueSamples;
+    stats.chunkQueueOccupancyTotal = chunkQueueOccupancyTotal;
+    stats.chunkQueueOccupancyMax = chunkQueueOccupancyMax;
+    stats.chunkQueueCapacity = CHUNK_POOL_MAX_SIZE + DOWNLOAD_PRODUCER_COUNT;
+    stats.chunkBuffers = chunkBuffersAllocated;
+}
+
+static bool workerMayTakeJob(uint8_t worker) {
+    if (worker == 0) return true;
+    return worker < activeWorkerLimit && ESP.getFreeHeap() >= WORKER_MIN_FREE_HEAP;
+}
+
+// Called by each worker after a job. Cheap unless a sampling period has elapsed.
+static void adaptConcurrency() {
+    static unsigned long lastSampleMillis = 0;
+    static uint32_t lastSampleBytes = 0;
+    static uint32_t lastRate = 0;   // Bytes per second over the previous period
+    static bool probing = false;    // The previous period started with one more worker
+    static uint8_t holdoff = 0;
+
+    if (xSemaphoreTake(concurrencyLock, 0) != pdTRUE) return; // Another worker is sampling
+    unsigned long now = millis();
+    if (now - lastSampleMillis >= CONCURRENCY_SAMPLE_MS) {
+        uint32_t bytes = totalBytesReceived;
+        uint32_t rate = (uint64_t)(bytes - lastSampleBytes) * 1000 / (now - lastSampleMillis);
+        uint8_t limit = activeWorkerLimit;
+        bool wasProbing = probing;
+        probing = false;
+
+        if (ESP.getFreeHeap() < WORKER_MIN_FREE_HEAP) {
+            if (limit > 1) limit--;
+        } else if (wasProbing && rate < lastRate + lastRate / 10) {
+            limit--; // The extra worker did not pay off
+            holdoff = CONCURRENCY_HOLDOFF;
+        } else if (holdoff > 0) {
+            holdoff--;
+        } else if (limit < DOWNLOAD_WORKER_COUNT && uxSemaphoreGetCount(jobsPending) > 0) {
+            limit++;
+            probing = true;
+        }
+
+        if (limit != activeWorkerLimit) {
+            Serial.printf("[DownloadTask] Active workers %u -> %u (%lu KB/s, Free Heap: %u)\n",
+                          (unsigned)activeWorkerLimit, (unsigned)limit, (unsigned long)(rate / 1024),
+                          (unsigned int)ESP.getFreeHeap());
+            activeWorkerLimit = limit;
+        }
+        lastRate = rate;
+        lastSampleBytes = bytes;
+        lastSampleMillis = now;
+    }
+    xSemaphoreGive(concurrencyLock);
+}
 
 // --- Initialization ---
 void initFileDownloadHandler() {
     size_t freeHeap = ESP.getFreeHeap();
     size_t usableHeapForTasks = freeHeap / 2; // Reserve half for system, wifi, ssl
-    size_t dynamicStackSize = usableHeapForTasks / 2; // Split remaining between the two tasks
+    size_t dynamicStackSize = usableHeapForTasks / 2; // Split remaining between download and write tasks
 
     // Clamp stack size to reasonable limits
     if (dynamicStackSize < 6144) dynamicStackSize = 6144; // Minimum for HTTPClient with SSL
@@ -49,227 +496,1480 @@ void initFileDownloadHandler() {
     Serial.printf("[FileHandler] Initializing. Free heap: %u, Calculated stack per task: %u\n",
                   (unsigned int)freeHeap, (unsigned int)dynamicStackSize);
 
-    if (!urlQueue) {
-        urlQueue = xQueueCreate(URL_QUEUE_LENGTH, URL_MAX_LENGTH);
-        if (!urlQueue) Serial.println("[FileHandler] ERROR: Failed to create urlQueue!");
+    if (!schedulerLock) {
+        schedulerLock = xSemaphoreCreateMutex();
+        jobsPending = xSemaphoreCreateCounting(URL_QUEUE_LENGTH, 0);
+        freeEntries = xSemaphoreCreateCounting(URL_QUEUE_LENGTH, URL_QUEUE_LENGTH);
+        if (!schedulerLock || !jobsPending || !freeEntries) Serial.println("[FileHandler] ERROR: Failed to create job scheduler!");
+    }
+    if (!chunkPoolLock) {
+        chunkPoolLock = xSemaphoreCreateMutex();
+        chunkPoolUsesPsram = psramFound();
+        int budget = chunkPoolUsesPsram ? CHUNK_POOL_PSRAM_BUDGET : CHUNK_POOL_HEAP_BUDGET;
+        chunkPoolLimit = std::min(CHUNK_POOL_SIZE + budget / CHUNK_SIZE, CHUNK_POOL_MAX_SIZE);
+        Serial.printf("[FileHandler] Chunk pool: %d buffers, up to %d in %s.\n",
+                      CHUNK_POOL_SIZE, chunkPoolLimit, chunkPoolUsesPsram ? "PSRAM" : "internal RAM");
+    }
+    if (!freeChunkQueue) {
+        freeChunkQueue = xQueueCreate(CHUNK_POOL_MAX_SIZE, sizeof(uint8_t));
+        if (!freeChunkQueue) {
+            Serial.println("[FileHandler] ERROR: Failed to create freeChunkQueue!");
+        } else {
+            for (uint8_t i = 0; i < CHUNK_POOL_SIZE; i++) {
+                chunkPool[i] = chunkBaseBuffers[i];
+                xQueueSend(freeChunkQueue, &i, 0);
+            }
+        }
     }
-    if (!chunkQueue) {
-        chunkQueue = xQueueCreate(CHUNK_QUEUE_LENGTH, sizeof(FileChunk));
+    if (!chunkQueue && freeChunkQueue) {
+        // Extra slots so every producer's marker fits even when every buffer is queued
+        chunkQueue = xQueueCreate(CHUNK_POOL_MAX_SIZE + DOWNLOAD_PRODUCER_COUNT, sizeof(ChunkDescriptor));
         if (!chunkQueue) Serial.println("[FileHandler] ERROR: Failed to create chunkQueue!");
     }
+    if (!freeJobQueue) {
+        freeJobQueue = xQueueCreate(JOB_SLOT_COUNT, sizeof(uint8_t));
+        if (!freeJobQueue) {
+            Serial.println("[FileHandler] ERROR: Failed to create freeJobQueue!");
+        } else {
+            for (uint8_t i = 0; i < JOB_SLOT_COUNT; i++) xQueueSend(freeJobQueue, &i, 0);
+        }
+    }
+    if (!concurrencyLock) concurrencyLock = xSemaphoreCreateMutex();
+    initSampleIndex();
+    initConnectionPool();
+    if (!progressTaskHandle) {
+        // Below the pipeline tasks: a late frame only delays the display
+        xTaskCreatePinnedToCore(progressTask, "ProgressTask", PROGRESS_STACK_SIZE, NULL, 1, &progressTaskHandle, 1);
+    }
 
-    if (!downloadTaskHandle && urlQueue && chunkQueue) { // Only create task if queues are up
-        xTaskCreatePinnedToCore(downloadTask, "DownloadTask", dynamicStackSize, NULL, 2, &downloadTaskHandle, 0); // Core 0 for Network
+    for (uint8_t worker = 0; worker < DOWNLOAD_WORKER_COUNT && jobsPending && freeEntries && chunkQueue && freeJobQueue && concurrencyLock; worker++) {
+        if (!downloadTaskHandles[worker]) {
+            // The worker number is passed as the task parameter
+            xTaskCreatePinnedToCore(downloadTask, "DownloadTask", dynamicStackSize, (void*)(uintptr_t)worker,
+                                    2, &downloadTaskHandles[worker], 0); // Core 0 for Network
+        }
     }
     if (!writeTaskHandle && chunkQueue) { // Only create task if its queue is up
         xTaskCreatePinnedToCore(writeTask, "WriteTask", dynamicStackSize, NULL, 2, &writeTaskHandle, 1);    // Core 1 for SD
     }
+#if SEGMENTED_DOWNLOAD
+    if (!segmentLock) segmentLock = xSemaphoreCreateMutex();
+    if (!segmentTasksIdle) segmentTasksIdle = xSemaphoreCreateCounting(SEGMENT_CONNECTIONS, 0);
+    if (!segmentLanesOwner) segmentLanesOwner = xSemaphoreCreateMutex();
+    for (uint8_t lane = 1; lane < SEGMENT_CONNECTIONS && segmentLock && segmentTasksIdle && segmentLanesOwner; lane++) {
+        if (!segmentTaskHandles[lane - 1]) {
+            // The lane number is passed as the task parameter
+            xTaskCreatePinnedToCore(segmentTask, "SegmentTask", dynamicStackSize, (void*)(uintptr_t)lane,
+                                    2, &segmentTaskHandles[lane - 1], 0); // Core 0 for Network
+        }
+    }
+#endif
+}
+
+// --- Job Scheduling ---
+#if SHORTEST_JOB_FIRST
+static uint32_t remainingBytes(const DownloadRequest& request) {
+    int32_t size = request.expectedLength >= 0 ? request.expectedLength : request.sizeHint;
+    return size >= 0 ? (uint32_t)size - request.resumeOffset : UINT32_MAX;
+}
+#endif
+
+// Interactive before bulk, then (optionally) fewest remaining bytes, then arrival order.
+// A preempted job keeps its sequence number, so it continues before later jobs of its class.
+static bool runsBefore(const DownloadRequest& a, const DownloadRequest& b) {
+    if (a.priority != b.priority) return a.priority < b.priority;
+#if SHORTEST_JOB_FIRST
+    uint32_t remainingA = remainingBytes(a), remainingB = remainingBytes(b);
+    if (remainingA != remainingB) return remainingA < remainingB;
+#endif
+    return (int32_t)(a.sequence - b.sequence) < 0;
+}
+
+// Index of the job to run next, -1 if none. Call with schedulerLock held.
+static int nextPendingJob() {
+    int next = -1;
+    for (int i = 0; i < URL_QUEUE_LENGTH; i++) {
+        if (pendingUsed[i] && (next < 0 || runsBefore(pendingJobs[i], pendingJobs[next]))) next = i;
+    }
+    return next;
+}
+
+// Stores `request` in an unused entry. The caller has taken freeEntries. Call with schedulerLock held.
+// Entries are small handles; the strings stay in the arena.
+static void insertPendingJob(const DownloadRequest& request) {
+    for (int i = 0; i < URL_QUEUE_LENGTH; i++) {
+        if (pendingUsed[i]) continue;
+        pendingJobs[i] = request;
+        pendingUsed[i] = true;
+        if (request.priority == JOB_PRIORITY_INTERACTIVE) interactivePending++;
+        xSemaphoreGive(jobsPending);
+        return;
+    }
+}
+
+// Moves the job that should run next into `request`. If `requeue` is set, `request` holds a
+// preempted job, which goes back into the schedule in the same critical section, so no other
+// worker preempts again for the interactive job this one yielded to.
+static bool takeNextJob(DownloadRequest& request, bool requeue, TickType_t timeout) {
+    if (requeue) {
+        xSemaphoreTake(schedulerLock, portMAX_DELAY);
+        insertPendingJob(request); // Its entry was reserved when the job was preempted
+        preemptionsInFlight--;
+        xSemaphoreTake(jobsPending, 0); // Just given by insertPendingJob()
+    } else {
+        if (xSemaphoreTake(jobsPending, timeout) != pdTRUE) return false;
+        xSemaphoreTake(schedulerLock, portMAX_DELAY);
+    }
+    int next = nextPendingJob();
+    request = pendingJobs[next];
+    pendingUsed[next] = false;
+    if (request.priority == JOB_PRIORITY_INTERACTIVE) interactivePending--;
+    xSemaphoreGive(schedulerLock);
+    xSemaphoreGive(freeEntries);
+    return true;
+}
+
+// Called by a bulk job between chunks. True if it should stop and yield its worker to an
+// interactive job that has found no free worker; the job's place in the schedule is reserved.
+static bool shouldPreempt() {
+    if (interactivePending == 0) return false; // Checked without the lock on every chunk
+    bool preempt = false;
+    xSemaphoreTake(schedulerLock, portMAX_DELAY);
+    if (interactivePending > preemptionsInFlight) {
+        for (int i = 0; i < URL_QUEUE_LENGTH && !preempt; i++) {
+            preempt = pendingUsed[i] && pendingJobs[i].priority == JOB_PRIORITY_INTERACTIVE &&
+                      millis() - pendingJobs[i].enqueuedAt >= PREEMPT_GRACE_MS;
+        }
+        if (preempt) preempt = xSemaphoreTake(freeEntries, 0) == pdTRUE; // Room to requeue this job
+        if (preempt) preemptionsInFlight++;
+    }
+    xSemaphoreGive(schedulerLock);
+    return preempt;
+}
+
+// Frees the job's arena record once a worker is done with it
+static void releaseJobRecord(const DownloadRequest& request) {
+    xSemaphoreTake(schedulerLock, portMAX_DELAY);
+    arenaFree(request.record);
+    xSemaphoreGive(schedulerLock);
 }
 
 // --- Enqueue URL for Download ---
-void enqueueDownloadUrl(const char* url, const char* s3Key) { // Pass s3Key for filename
-    if (urlQueue && url && s3Key) {
-        char urlToQueue[URL_MAX_LENGTH];
-        strncpy(urlToQueue, url, URL_MAX_LENGTH - 1);
-        urlToQueue[URL_MAX_LENGTH - 1] = '\0';
-
-        if (xQueueSend(urlQueue, urlToQueue, pdMS_TO_TICKS(100)) != pdPASS) {
-            Serial.println("[FileHandler] Failed to enqueue URL, queue full?");
-        } else {
-            Serial.printf("[FileHandler] Enqueued URL for key: %s\n", s3Key);
+void enqueueDownloadUrl(const char* url, const char* s3Key, const DownloadOptions& options) { // Pass s3Key for filename
+    if (schedulerLock && url && s3Key) {
+        size_t urlLength = strnlen(url, URL_MAX_LENGTH);
+        size_t keyLength = strnlen(s3Key, S3_KEY_MAX_LENGTH - 1);
+        if (urlLength == URL_MAX_LENGTH) {
+            Serial.printf("[FileHandler] URL for key %s is too long, skipped.\n", s3Key);
+            dropBatchFile(options.batch);
+            return;
         }
+        uint32_t recordSize = (sizeof(ArenaRecord) + urlLength + 1 + keyLength + 1 + 3) & ~3u;
+        // A full scheduler holds the caller back until workers take or finish jobs, rather than
+        // dropping the file: presigned URLs are long, so the arena fills well before the entries do
+        if (xSemaphoreTake(freeEntries, 0) != pdTRUE) {
+            Serial.println("[FileHandler] Job queue full, waiting for a worker to take a job.");
+            xSemaphoreTake(freeEntries, portMAX_DELAY);
+        }
+        int32_t offset;
+        for (bool waiting = false; ; waiting = true) {
+            xSemaphoreTake(schedulerLock, portMAX_DELAY);
+            offset = arenaAllocate(recordSize);
+            if (offset >= 0) break;
+            xSemaphoreGive(schedulerLock);
+            if (!waiting) Serial.println("[FileHandler] Job arena full, waiting for a job to finish.");
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+
+        ArenaRecord* record = arenaRecord(offset);
+        record->live = 1;
+        record->size = recordSize;
+        record->keyOffset = sizeof(ArenaRecord) + urlLength + 1;
+        record->etag[0] = '\0';
+        if (options.etag) {
+            strncpy(record->etag, options.etag, sizeof(record->etag) - 1);
+            record->etag[sizeof(record->etag) - 1] = '\0';
+        }
+        memcpy(record->url, url, urlLength);
+        record->url[urlLength] = '\0';
+        memcpy(record->url + urlLength + 1, s3Key, keyLength);
+        record->url[urlLength + 1 + keyLength] = '\0';
+
+        DownloadRequest request;
+        request.record = offset;
+        request.priority = options.priority == JOB_PRIORITY_INTERACTIVE ? JOB_PRIORITY_INTERACTIVE : JOB_PRIORITY_BULK;
+        request.sizeHint = options.sizeHint;
+        request.encoding = options.encoding;
+        request.container = options.container;
+        request.sequence = nextSequence++;
+        request.enqueuedAt = millis();
+        request.resumeOffset = 0;
+        request.expectedLength = -1;
+        request.batch = options.batch;
+        request.batchSized = false;
+        request.batchKnownBytes = 0;
+        request.batchTransferredBytes = 0;
+        if (options.sizeHint >= 0) updateBatchShare(request, options.sizeHint, 0, true);
+        insertPendingJob(request);
+        xSemaphoreGive(schedulerLock);
+        Serial.printf("[FileHandler] Enqueued %s URL for key: %s\n",
+                      request.priority == JOB_PRIORITY_INTERACTIVE ? "interactive" : "bulk", s3Key);
     } else {
         Serial.println("[FileHandler] Cannot enqueue URL: Queue not init or URL/key is null.");
+        dropBatchFile(options.batch);
     }
 }
 
 
 // --- Download Task (Core 0) ---
-void downloadTask(void* pvParameters) {
-    Serial.println("[DownloadTask] Started.");
-    while (!urlQueue || !chunkQueue) {
-        Serial.println("[DownloadTask] Waiting for queues to be initialized...");
-        vTaskDelay(pdMS_TO_TICKS(1000));
+enum DownloadResult {
+    DOWNLOAD_OK,
+    DOWNLOAD_RETRY,   // Transient failure: retry from the committed offset
+    DOWNLOAD_FAILED,  // Permanent failure, e.g. an expired presigned URL
+    DOWNLOAD_PREEMPTED, // Stopped between chunks for an interactive job; resumes later from the committed offset
+};
+
+static void sendJobEndMarker(uint16_t jobId, uint8_t flags, const char* filename) {
+    ChunkDescriptor marker = { CHUNK_NO_BUFFER, (uint8_t)(CHUNK_FLAG_LAST | flags), 0, jobId, 0, 0 };
+    if (!sendChunk(marker)) {
+        Serial.printf("[DownloadTask] CRITICAL: Failed to send LAST CHUNK marker for %s!\n", filename);
+    } else {
+        Serial.printf("[DownloadTask] Sent LAST CHUNK marker for %s.\n", filename);
     }
+}
 
-    char currentPresignedUrl[URL_MAX_LENGTH];
-    // TODO: fileCounter and totalFilesForBatch should ideally be managed based on
-    // the number of URLs received in one MQTT message batch.
-    int fileDownloadAttemptCounter = 0; 
+// Extract filename from the S3 key part of the URL
+static void extractFilename(const char* url, char* filename, size_t filenameSize) {
+    strncpy(filename, "unknown.dat", filenameSize - 1); // Default
+    filename[filenameSize - 1] = '\0';
+    const char* s3KeyStart = strstr(url, ".com/"); // Find end of domain
+    if (s3KeyStart) {
+        s3KeyStart += strlen(".com/"); // Move past ".com/"
+        const char* queryParams = strchr(s3KeyStart, '?');
+        int keyLength = 0;
+        if (queryParams) {
+            keyLength = queryParams - s3KeyStart;
+        } else {
+            keyLength = strlen(s3KeyStart);
+        }
 
-    for (;;) {
-        if (xQueueReceive(urlQueue, currentPresignedUrl, portMAX_DELAY) == pdTRUE) {
-            fileDownloadAttemptCounter++;
-            Serial.printf("[DownloadTask] Processing URL #%d: %s\n", fileDownloadAttemptCounter, currentPresignedUrl);
-
-            if (WiFi.status() != WL_CONNECTED) {
-                Serial.println("[DownloadTask] WiFi not connected! Skipping download.");
-                // Send a dummy "last chunk" marker so writeTask doesn't stall if it expects one for this URL
-                FileChunk errorMarker;
-                errorMarker.isLast = true;
-                errorMarker.length = 0;
-                errorMarker.filename[0] = '\0';
-                xQueueSend(chunkQueue, &errorMarker, pdMS_TO_TICKS(100));
-                continue;
+        if (keyLength > 0) {
+            const char* lastSlashInKey = NULL;
+            for (int i = keyLength - 1; i >= 0; i--) {
+                if (s3KeyStart[i] == '/') {
+                    lastSlashInKey = &s3KeyStart[i];
+                    break;
+                }
             }
+            const char* namePart = lastSlashInKey ? lastSlashInKey + 1 : s3KeyStart;
+            int namePartLength = keyLength - (namePart - s3KeyStart);
 
-            // Extract filename from the S3 key part of the URL
-            char extractedFilename[sizeof(FileChunk::filename)] = "unknown.dat"; // Default
-            const char* s3KeyStart = strstr(currentPresignedUrl, ".com/"); // Find end of domain
-            if (s3KeyStart) {
-                s3KeyStart += strlen(".com/"); // Move past ".com/"
-                const char* queryParams = strchr(s3KeyStart, '?');
-                int keyLength = 0;
-                if (queryParams) {
-                    keyLength = queryParams - s3KeyStart;
-                } else {
-                    keyLength = strlen(s3KeyStart);
+            if (namePartLength >= (int)filenameSize) {
+                namePartLength = filenameSize - 1;
+            }
+            strncpy(filename, namePart, namePartLength);
+            filename[namePartLength] = '\0';
+        }
+    }
+}
+
+// Returns the byte offset to resume from if an on-card journal matches this job, else 0
+static uint32_t resumeOffsetFromJournal(JobInfo& job) {
+    DownloadJournal journal;
+    if (!loadDownloadJournal(job.filename, journal)) return 0;
+    if (strcmp(journal.s3Key, job.s3Key) != 0 || journal.committedBytes >= journal.expectedLength) {
+        return 0;
+    }
+
+    // The partial file must still hold everything the journal says was committed
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", STAGING_DIRECTORY, job.filename);
+    StorageStat partial;
+    if (!storage().stat(path, partial) || partial.size < journal.committedBytes) return 0;
+
+    strcpy(job.etag, journal.etag);
+    job.expectedLength = journal.expectedLength;
+    Serial.printf("[DownloadTask] Journal found for %s: resuming at %lu/%lu bytes\n",
+                  job.filename, (unsigned long)journal.committedBytes, (unsigned long)journal.expectedLength);
+    return journal.committedBytes;
+}
+
+// True if the card already holds the current version of the job's object: the sample index
+// says the file came from the same key, and the batch gave the same ETag. If the batch gave
+// none, sets job.cachedEtag so the request becomes conditional and the server answers 304
+// when nothing changed.
+static bool isUnchangedOnCard(JobInfo& job) {
+    SampleRecord record;
+    if (!findSampleRecord(job.filename, record)) return false;
+    if (record.etag[0] == '\0' || strcmp(record.s3Key, job.s3Key) != 0) return false;
+
+    // The index is only updated by this device, so check the file was not changed elsewhere
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", SAMPLE_DIRECTORY, job.filename);
+    StorageStat existing;
+    if (!storage().stat(path, existing) || existing.size != record.size) return false;
+
+    if (job.etag[0] != '\0') return strcmp(job.etag, record.etag) == 0;
+    strcpy(job.cachedEtag, record.etag);
+    return false;
+}
+
+// Total object size from "Content-Range: bytes <first>-<last>/<total>", -1 if absent
+static int32_t totalFromContentRange(const String& contentRange) {
+    const char* slash = strrchr(contentRange.c_str(), '/');
+    if (!slash || slash[1] == '*') return -1;
+    return atol(slash + 1);
+}
+
+// Streams one response body into chunk descriptors for `lane`, the first byte landing at file
+// offset `offset`. If firstChunkPending is set, the first chunk carries CHUNK_FLAG_FIRST.
+// A preemptible body stops between chunks when an interactive job needs the worker.
+static DownloadResult streamBody(HTTPClient& http, PooledClient* client, uint16_t jobId, uint8_t lane, uint32_t offset,
+                                 int bodyLength, bool& firstChunkPending, int fileNumber, bool preemptible) {
+    JobInfo& job = jobInfoFor(jobId);
+    const char* extractedFilename = job.filename;
+    WiFiClient* stream = http.getStreamPtr();
+    DownloadResult result = DOWNLOAD_OK;
+    int bytesDownloaded = 0;
+
+    while (http.connected() && (bodyLength == -1 || bytesDownloaded < bodyLength)) {
+        // Sleeps until data arrives instead of polling, so no TCP segment waits on a fixed nap
+        if (!client->waitForData(STREAM_READ_TIMEOUT_MS)) {
+            if (client->connected()) {
+                Serial.printf("[DownloadTask] No data for %d ms on %s.\n", STREAM_READ_TIMEOUT_MS, extractedFilename);
+                result = DOWNLOAD_RETRY;
+                break;
+            }
+        } else {
+            // Blocks here, not on chunkQueue, when writeTask falls behind
+            uint8_t bufferIndex;
+            if (!takeChunkBuffer(bufferIndex)) {
+                Serial.printf("[DownloadTask] No free chunk buffer for %s! Aborting file.\n", extractedFilename);
+                result = DOWNLOAD_FAILED;
+                break;
+            }
+            // Take everything already received, up to a full buffer and never past the body
+            size_t wanted = CHUNK_SIZE;
+            if (bodyLength > 0 && (size_t)(bodyLength - bytesDownloaded) < wanted) wanted = bodyLength - bytesDownloaded;
+            int bytesRead = 0;
+            do {
+                uint32_t readStartUs = micros();
+                int n = stream->read(chunkPool[bufferIndex] + bytesRead, wanted - bytesRead);
+                recordStageLatency(STAGE_STREAM_READ, micros() - readStartUs);
+                if (n <= 0) {
+                    if (bytesRead == 0) bytesRead = n;
+                    break;
                 }
+                bytesRead += n;
+            } while ((size_t)bytesRead < wanted && stream->available() > 0);
 
-                if (keyLength > 0) {
-                    const char* lastSlashInKey = NULL;
-                    for (int i = keyLength - 1; i >= 0; i--) {
-                        if (s3KeyStart[i] == '/') {
-                            lastSlashInKey = &s3KeyStart[i];
-                            break;
-                        }
-                    }
-                    const char* namePart = lastSlashInKey ? lastSlashInKey + 1 : s3KeyStart;
-                    int namePartLength = keyLength - (namePart - s3KeyStart);
+            if (bytesRead > 0) {
+                ChunkDescriptor chunk = { bufferIndex, 0, lane, jobId, (uint16_t)bytesRead, offset + bytesDownloaded };
+                bytesDownloaded += bytesRead;
+                if (firstChunkPending) {
+                    chunk.flags |= CHUNK_FLAG_FIRST;
+                    firstChunkPending = false;
+                }
 
-                    if (namePartLength >= sizeof(extractedFilename)) {
-                        namePartLength = sizeof(extractedFilename) - 1;
-                    }
-                    strncpy(extractedFilename, namePart, namePartLength);
-                    extractedFilename[namePartLength] = '\0';
+                if (!sendChunk(chunk)) {
+                    Serial.printf("[DownloadTask] Failed to send data chunk for %s! Aborting file.\n", extractedFilename);
+                    releaseChunkBuffer(chunk);
+                    result = DOWNLOAD_FAILED;
+                    break;
+                }
+                uint32_t received = job.receivedBytes.fetch_add(bytesRead) + bytesRead;
+                totalBytesReceived += bytesRead;
+                if (lane == 0) { // Progress follows the worker's own connection
+                    updateBatchShare(*job.request, job.request->batchKnownBytes, job.startOffset + received, false);
+                    int percent = 0;
+                    if (job.expectedLength > 0) percent = ((int64_t)(job.startOffset + received) * 100) / job.expectedLength;
+                    else if (job.expectedLength == 0) percent = 100; 
+                    publishDownloadProgress(fileNumber, percent);
+                }
+                if (preemptible && (bodyLength == -1 || bytesDownloaded < bodyLength) && shouldPreempt()) {
+                    Serial.printf("[DownloadTask] Preempting %s at byte %lu for an interactive job.\n",
+                                  extractedFilename, (unsigned long)(offset + bytesDownloaded));
+                    result = DOWNLOAD_PREEMPTED;
+                    break;
+                }
+
+            } else {
+                ChunkDescriptor unused = { bufferIndex, 0, lane, jobId, 0, 0 };
+                releaseChunkBuffer(unused);
+                if (bytesRead < 0) { // Error on read
+                    Serial.printf("[DownloadTask] Stream read error for %s.\n", extractedFilename);
+                    result = DOWNLOAD_RETRY;
+                    break;
+                }
+            }
+        }
+         if (!http.connected() && (bodyLength == -1 || bytesDownloaded < bodyLength)) {
+            Serial.printf("[DownloadTask] HTTP disconnected prematurely for %s.\n", extractedFilename);
+            result = DOWNLOAD_RETRY;
+            break;
+        }
+    } // while http.connected
+    if (bytesDownloaded != bodyLength && bodyLength > 0) {
+        Serial.printf("[DownloadTask] WARN: Bytes downloaded (%d) != body length (%d) for %s\n",
+                      bytesDownloaded, bodyLength, extractedFilename);
+    }
+    return result;
+}
+
+// Streams a compressed response body through `decoder`, queueing the decoded bytes from file
+// offset 0. The compressed input is staged in a chunk buffer of its own. Not preemptible: a
+// compressed job cannot resume mid-stream.
+static DownloadResult streamDecodedBody(HTTPClient& http, PooledClient* client, uint16_t jobId, int bodyLength,
+                                        StreamDecoder* decoder, bool& firstChunkPending, int fileNumber) {
+    JobInfo& job = jobInfoFor(jobId);
+    const char* extractedFilename = job.filename;
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t inputIndex;
+    if (!takeChunkBuffer(inputIndex)) {
+        Serial.printf("[DownloadTask] No free chunk buffer for %s! Aborting file.\n", extractedFilename);
+        return DOWNLOAD_FAILED;
+    }
+    uint8_t* input = chunkPool[inputIndex];
+    size_t inputPos = 0, inputFill = 0;
+    uint8_t outputIndex = CHUNK_NO_BUFFER;
+    size_t outputFill = 0;
+    int bytesDownloaded = 0;    // Compressed
+    uint32_t bytesDecoded = 0;
+    unsigned long decodeMicros = 0;
+    bool bodyDone = false;
+    DownloadResult result = DOWNLOAD_OK;
+
+    for (;;) {
+        if (inputPos == inputFill && !bodyDone) {
+            if (bodyLength != -1 && bytesDownloaded >= bodyLength) {
+                bodyDone = true;
+            } else if (!client->waitForData(STREAM_READ_TIMEOUT_MS)) {
+                if (client->connected()) {
+                    Serial.printf("[DownloadTask] No data for %d ms on %s.\n", STREAM_READ_TIMEOUT_MS, extractedFilename);
+                    result = DOWNLOAD_RETRY;
+                    break;
                 }
+                bodyDone = true; // Closed by the server; only fine if the body had no length
+                if (bodyLength != -1) {
+                    Serial.printf("[DownloadTask] HTTP disconnected prematurely for %s.\n", extractedFilename);
+                    result = DOWNLOAD_RETRY;
+                    break;
+                }
+            } else {
+                size_t wanted = CHUNK_SIZE;
+                if (bodyLength > 0 && (size_t)(bodyLength - bytesDownloaded) < wanted) wanted = bodyLength - bytesDownloaded;
+                uint32_t readStartUs = micros();
+                int n = stream->read(input, wanted);
+                recordStageLatency(STAGE_STREAM_READ, micros() - readStartUs);
+                if (n < 0) {
+                    Serial.printf("[DownloadTask] Stream read error for %s.\n", extractedFilename);
+                    result = DOWNLOAD_RETRY;
+                    break;
+                }
+                inputPos = 0;
+                inputFill = n;
+                bytesDownloaded += n;
+                job.receivedBytes += n;
+                totalBytesReceived += n;
+                updateBatchShare(*job.request, job.request->batchKnownBytes, bytesDownloaded, false);
+                if (bodyLength > 0) publishDownloadProgress(fileNumber, ((int64_t)bytesDownloaded * 100) / bodyLength);
+            }
+        }
+
+        if (outputIndex == CHUNK_NO_BUFFER) {
+            if (!takeChunkBuffer(outputIndex)) {
+                Serial.printf("[DownloadTask] No free chunk buffer for %s! Aborting file.\n", extractedFilename);
+                result = DOWNLOAD_FAILED;
+                break;
             }
-            Serial.printf("[DownloadTask] Target filename: %s\n", extractedFilename);
+            outputFill = 0;
+        }
+        size_t inLength = inputFill - inputPos;
+        size_t outLength = CHUNK_SIZE - outputFill;
+        bool inputEnds = bodyDone || (bodyLength != -1 && bytesDownloaded >= bodyLength);
+        unsigned long decodeStart = micros();
+        DecodeStatus status = streamDecode(decoder, input + inputPos, inLength, chunkPool[outputIndex] + outputFill, outLength, inputEnds);
+        decodeMicros += micros() - decodeStart;
+        inputPos += inLength;
+        outputFill += outLength;
+        if (status == DECODE_ERROR) {
+            Serial.printf("[DownloadTask] Corrupt compressed data in %s.\n", extractedFilename);
+            result = DOWNLOAD_FAILED; // Fetching the same bytes again will not help
+            break;
+        }
 
-            HTTPClient http;
-            WiFiClientSecure clientSecure; // Use a new client for each request for safety
+        // The decoder is drained once it leaves the output buffer part empty with no input left
+        bool drained = bodyDone && inputPos == inputFill && outputFill < CHUNK_SIZE;
+        if (outputFill == CHUNK_SIZE || (drained && outputFill > 0)) {
+            ChunkDescriptor chunk = { outputIndex, 0, 0, jobId, (uint16_t)outputFill, bytesDecoded };
+            if (firstChunkPending) {
+                chunk.flags |= CHUNK_FLAG_FIRST;
+                firstChunkPending = false;
+            }
+            outputIndex = CHUNK_NO_BUFFER;
+            if (!sendChunk(chunk)) {
+                Serial.printf("[DownloadTask] Failed to send data chunk for %s! Aborting file.\n", extractedFilename);
+                releaseChunkBuffer(chunk);
+                result = DOWNLOAD_FAILED;
+                break;
+            }
+            bytesDecoded += chunk.length;
+        }
+        if (drained) {
+            if (!streamDecoderAtEnd(decoder)) {
+                Serial.printf("[DownloadTask] Compressed stream of %s ended early.\n", extractedFilename);
+                result = DOWNLOAD_RETRY;
+            }
+            break;
+        }
+    }
 
-            // --- CRITICAL: SET THE ROOT CA CERTIFICATE ---
-            clientSecure.setCACert(AWS_CERT_CA); 
+    ChunkDescriptor unused = { inputIndex, 0, 0, jobId, 0, 0 };
+    releaseChunkBuffer(unused);
+    if (outputIndex != CHUNK_NO_BUFFER) {
+        unused.bufferIndex = outputIndex;
+        releaseChunkBuffer(unused);
+    }
+    // Decode cost on this device, to weigh against the Wi-Fi time saved
+    Serial.printf("[DownloadTask] Decoded %s: %d -> %lu bytes, %lu ms decoding (%lu ms/MB of output)\n",
+                  extractedFilename, bytesDownloaded, (unsigned long)bytesDecoded, decodeMicros / 1000,
+                  (unsigned long)(bytesDecoded ? (uint64_t)decodeMicros * 1024 / bytesDecoded : 0));
+    return result;
+}
 
-            bool downloadSuccessful = false;
-            int totalBytesExpected = -1;
-            int bytesDownloadedThisFile = 0;
-            bool firstDataChunkSent = false;
+#if SEGMENTED_DOWNLOAD
+// The byte ranges of the job currently being fetched in segments. Guarded by segmentLock.
+struct SegmentedJob {
+    const char* url;
+    uint16_t jobId;
+    int fileNumber;
+    uint32_t nextOffset;    // Start of the next segment to hand out
+    uint32_t endOffset;     // Object size
+    volatile bool failed;   // Set by any lane; stops the others at their next segment
+};
+static SegmentedJob segmentedJob;
 
-            Serial.printf("[DownloadTask] HTTP Begin for: %s\n", extractedFilename);
-            if (http.begin(clientSecure, currentPresignedUrl)) {
-                Serial.printf("[DownloadTask] HTTP GET for: %s\n", extractedFilename);
-                int httpCode = http.GET();
+// Fetches bytes [start, end) of the segmented job on its own connection
+static DownloadResult fetchRange(uint8_t lane, uint32_t start, uint32_t end) {
+    JobInfo& job = jobInfoFor(segmentedJob.jobId);
+    HTTPClient http;
+    PooledClient* clientSecure = acquireConnection(segmentedJob.url);
+    if (!clientSecure) return DOWNLOAD_RETRY;
 
-                if (httpCode > 0) { // Positive code means server responded
-                    if (httpCode == HTTP_CODE_OK) {
-                        downloadSuccessful = true; // Tentatively
-                        WiFiClient* stream = http.getStreamPtr();
-                        totalBytesExpected = http.getSize();
-                        Serial.printf("[DownloadTask] File size: %d bytes for %s\n", totalBytesExpected, extractedFilename);
+    DownloadResult result = DOWNLOAD_RETRY;
+    uint32_t beginStartUs = micros();
+    bool begun = http.begin(*clientSecure, segmentedJob.url);
+    recordStageLatency(STAGE_HTTP_BEGIN, micros() - beginStartUs);
+    if (begun) {
+        http.setReuse(true);
+        char rangeHeader[40];
+        snprintf(rangeHeader, sizeof(rangeHeader), "bytes=%lu-%lu", (unsigned long)start, (unsigned long)(end - 1));
+        http.addHeader("Range", rangeHeader);
+        http.addHeader("If-Match", job.etag); // Never mix ranges from two versions of the object
 
-                        if (totalBytesExpected == 0) { // Handle 0-byte files explicitly
-                             showDownloadProgress(fileDownloadAttemptCounter, 100);
-                        }
+        uint32_t getStartUs = micros();
+        int httpCode = http.GET();
+        recordStageLatency(STAGE_HTTP_GET, micros() - getStartUs);
+        if (httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+            bool firstChunkPending = false;
+            result = streamBody(http, clientSecure, segmentedJob.jobId, lane, start, http.getSize(), firstChunkPending, segmentedJob.fileNumber, false);
+        } else {
+            Serial.printf("[SegmentTask] Lane %u: range %s of %s failed, Code: %d\n",
+                          lane, rangeHeader, job.filename, httpCode);
+        }
+        http.end();
+    }
+    releaseConnection(clientSecure, result == DOWNLOAD_OK);
+    return result;
+}
 
-                        while (http.connected() && (totalBytesExpected == -1 || bytesDownloadedThisFile < totalBytesExpected || totalBytesExpected == 0)) {
-                            if (stream->available()) {
-                                FileChunk chunk;
-                                chunk.length = stream->read(chunk.data, CHUNK_SIZE);
-
-                                if (chunk.length > 0) {
-                                    bytesDownloadedThisFile += chunk.length;
-                                    chunk.isLast = false; // This is a data chunk
-
-                                    if (!firstDataChunkSent) {
-                                        strncpy(chunk.filename, extractedFilename, sizeof(chunk.filename) - 1);
-                                        chunk.filename[sizeof(chunk.filename) - 1] = '\0';
-                                        firstDataChunkSent = true;
-                                    } else {
-                                        chunk.filename[0] = '\0';
-                                    }
-
-                                    if (xQueueSend(chunkQueue, &chunk, pdMS_TO_TICKS(5000)) != pdPASS) {
-                                        Serial.printf("[DownloadTask] Failed to send data chunk for %s! Aborting file.\n", extractedFilename);
-                                        downloadSuccessful = false;
-                                        break;
-                                    }
-                                    int percent = 0;
-                                    if (totalBytesExpected > 0) percent = (bytesDownloadedThisFile * 100) / totalBytesExpected;
-                                    else if (totalBytesExpected == 0) percent = 100; 
-                                    showDownloadProgress(fileDownloadAttemptCounter, percent);
-
-                                } else if (chunk.length < 0) { // Error on read
-                                    Serial.printf("[DownloadTask] Stream read error for %s.\n", extractedFilename);
-                                    downloadSuccessful = false;
-                                    break;
-                                }
-                            } else if (bytesDownloadedThisFile >= totalBytesExpected && totalBytesExpected != -1) {
-                                // All expected bytes read
-                                break;
-                            } else {
-                                vTaskDelay(pdMS_TO_TICKS(10)); // Yield
-                            }
-                             if (!http.connected() && (totalBytesExpected == -1 || bytesDownloadedThisFile < totalBytesExpected)) {
-                                Serial.printf("[DownloadTask] HTTP disconnected prematurely for %s.\n", extractedFilename);
-                                downloadSuccessful = false;
-                                break;
-                            }
-                        } // while http.connected
-                        if (bytesDownloadedThisFile != totalBytesExpected && totalBytesExpected > 0) {
-                            Serial.printf("[DownloadTask] WARN: Bytes downloaded (%d) != total expected (%d) for %s\n",
-                                          bytesDownloadedThisFile, totalBytesExpected, extractedFilename);
-                        }
+// Takes segments in offset order until the job is complete or has failed
+static void fetchSegments(uint8_t lane) {
+    for (;;) {
+        uint32_t start = 0, end = 0;
+        bool claimed = false;
+        xSemaphoreTake(segmentLock, portMAX_DELAY);
+        if (!segmentedJob.failed && segmentedJob.nextOffset < segmentedJob.endOffset) {
+            start = segmentedJob.nextOffset;
+            end = start + SEGMENT_SIZE;
+            if (end > segmentedJob.endOffset) end = segmentedJob.endOffset;
+            segmentedJob.nextOffset = end;
+            // Queued under the lock so writeTask sees segment starts in offset order
+            ChunkDescriptor marker = { CHUNK_NO_BUFFER, CHUNK_FLAG_SEGMENT, lane, segmentedJob.jobId, 0, start };
+            claimed = sendChunk(marker);
+            if (!claimed) segmentedJob.failed = true;
+        }
+        xSemaphoreGive(segmentLock);
+        if (!claimed) return;
+
+        if (fetchRange(lane, start, end) != DOWNLOAD_OK) {
+            segmentedJob.failed = true;
+            return;
+        }
+    }
+}
 
-                    } else { // HTTP code not OK
-                        Serial.printf("[DownloadTask] HTTP GET failed for %s, Code: %d\n", extractedFilename, httpCode);
-                        String errorPayload = http.getString(); // Get error body if any
-                        Serial.printf("[DownloadTask] HTTP Error Body: %s\n", errorPayload.c_str());
+// --- Segment Task (Core 0) ---
+// Extra connection for segmented downloads. Sleeps until a download worker hands it a job.
+void segmentTask(void* pvParameters) {
+    uint8_t lane = (uint8_t)(uintptr_t)pvParameters;
+    Serial.printf("[SegmentTask] Lane %u started.\n", lane);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        fetchSegments(lane);
+        xSemaphoreGive(segmentTasksIdle);
+    }
+}
+#endif
+
+// Has the connection pool open a connection for the next queued job while this body streams,
+// so the job starts without waiting for DNS, TCP and TLS
+static void preconnectNextJob() {
+    xSemaphoreTake(schedulerLock, portMAX_DELAY);
+    int next = nextPendingJob();
+    if (next >= 0) preconnectFor(jobUrl(pendingJobs[next])); // Only queues the host, never blocks
+    xSemaphoreGive(schedulerLock);
+}
+
+// One HTTP request for the job, starting at job.startOffset. Always ends with an end-of-job marker.
+// In segmented mode the request covers the first segment and the rest is fetched in parallel.
+static DownloadResult downloadAttempt(const char* url, uint16_t jobId, JobInfo& job, int fileNumber) {
+    const char* extractedFilename = job.filename;
+    DownloadResult result = DOWNLOAD_RETRY;
+    bool firstChunkPending = true;
+    job.receivedBytes = 0;
+
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("[DownloadTask] WiFi not connected! Skipping attempt.");
+        // Send the end marker anyway so writeTask doesn't stall waiting for this job
+        sendJobEndMarker(jobId, CHUNK_FLAG_FAILED, extractedFilename);
+        return result;
+    }
+
+    HTTPClient http;
+    // Pooled connection, still open if an earlier request went to the same host.
+    // The pool sets the root CA certificate on every connection.
+    PooledClient* clientSecure = acquireConnection(url);
+    if (!clientSecure) {
+        sendJobEndMarker(jobId, CHUNK_FLAG_FAILED, extractedFilename);
+        return result;
+    }
+
+    bool segmentable = false;
+    bool segmented = false;
+    unsigned long firstByteMillis = 0; // Dead time before the body starts: connect, request, server latency
+    StreamDecoder* decoder = nullptr;
+    if (job.encoding != CONTENT_ENCODING_IDENTITY) {
+        // Known compressed: wait for a decoder now rather than with the response pending
+        decoder = acquireStreamDecoder(job.encoding, DECODER_WAIT_MS);
+        if (!decoder) {
+            Serial.printf("[DownloadTask] No stream decoder for %s.\n", extractedFilename);
+            releaseConnection(clientSecure, true);
+            sendJobEndMarker(jobId, CHUNK_FLAG_FAILED, extractedFilename);
+            return result;
+        }
+    }
+#if SEGMENTED_DOWNLOAD
+    // The segment lanes serve one job at a time; other workers fetch their file as a single stream.
+    // Compressed objects and bundles are always fetched whole and in order.
+    segmentable = jobIsResumable(job) && xSemaphoreTake(segmentLanesOwner, 0) == pdTRUE;
+#endif
+    unsigned long startMillis = millis();
+
+    Serial.printf("[DownloadTask] HTTP Begin for: %s\n", extractedFilename);
+    uint32_t beginStartUs = micros();
+    bool begun = http.begin(*clientSecure, url);
+    recordStageLatency(STAGE_HTTP_BEGIN, micros() - beginStartUs);
+    if (begun) {
+        http.setReuse(true); // Sends "Connection: keep-alive" and leaves the socket open on http.end()
+        const char* responseHeaders[] = { "ETag", "Content-Range", "Content-Encoding" };
+        http.collectHeaders(responseHeaders, 3);
+        char rangeHeader[40];
+        if (segmentable) {
+            // Ask for the first segment only; Content-Range then tells us the full size
+            snprintf(rangeHeader, sizeof(rangeHeader), "bytes=%lu-%lu",
+                     (unsigned long)job.startOffset, (unsigned long)(job.startOffset + SEGMENT_SIZE - 1));
+            http.addHeader("Range", rangeHeader);
+            if (job.startOffset > 0 && job.etag[0] != '\0') http.addHeader("If-Range", job.etag);
+        } else if (job.startOffset > 0) {
+            snprintf(rangeHeader, sizeof(rangeHeader), "bytes=%lu-", (unsigned long)job.startOffset);
+            http.addHeader("Range", rangeHeader);
+            // If the object changed since the journal was written, S3 answers 200 with the full body
+            if (job.etag[0] != '\0') http.addHeader("If-Range", job.etag);
+        }
+        if (job.startOffset == 0 && job.cachedEtag[0] != '\0') http.addHeader("If-None-Match", job.cachedEtag);
+
+        Serial.printf("[DownloadTask] HTTP GET for: %s\n", extractedFilename);
+        uint32_t getStartUs = micros();
+        int httpCode = http.GET();
+        recordStageLatency(STAGE_HTTP_GET, micros() - getStartUs);
+        firstByteMillis = millis() - startMillis;
+
+        if (httpCode > 0) { // Positive code means server responded
+            if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+                int bodyLength = http.getSize();
+
+                if (httpCode == HTTP_CODE_OK) {
+                    if (job.startOffset > 0) {
+                        Serial.printf("[DownloadTask] Range not honoured for %s, restarting from byte 0.\n", extractedFilename);
                     }
-                } else { // http.GET() returned error (e.g., -1 to -11)
-                    Serial.printf("[DownloadTask] HTTP GET failed for %s, Client Error: %d (%s)\n",
-                                  extractedFilename, httpCode, http.errorToString(httpCode).c_str());
-                }
-                http.end();
-                Serial.printf("[DownloadTask] End URL processing for %s. Free Heap: %u, Min Free Heap: %u\n",
-                    extractedFilename,
-                    (unsigned int)ESP.getFreeHeap(),
-                    (unsigned int)ESP.getMinFreeHeap());
-            } else {
-                Serial.printf("[DownloadTask] HTTP Begin FAILED for %s.\n", extractedFilename);
+                    job.startOffset = 0;
+                    job.expectedLength = bodyLength;
+                } else {
+                    int32_t total = totalFromContentRange(http.header("Content-Range"));
+                    job.expectedLength = total >= 0 ? total : (bodyLength >= 0 ? (int32_t)job.startOffset + bodyLength : -1);
+                }
+                String etag = http.header("ETag");
+                if (etag.length() > 0) {
+                    strncpy(job.etag, etag.c_str(), sizeof(job.etag) - 1);
+                    job.etag[sizeof(job.etag) - 1] = '\0';
+                }
+                // The header wins over the batch flag; without one the batch flag is trusted
+                uint8_t encoding = job.encoding;
+                String contentEncoding = http.header("Content-Encoding");
+                if (contentEncoding.length() > 0) encoding = contentEncodingFromName(contentEncoding.c_str());
+                if (encoding != CONTENT_ENCODING_IDENTITY) job.expectedLength = -1; // Decoded size is unknown
+                Serial.printf("[DownloadTask] File size: %d bytes for %s (body %d bytes from offset %lu)\n",
+                              (int)job.expectedLength, extractedFilename, bodyLength, (unsigned long)job.startOffset);
+                // Compressed objects count in transferred (compressed) bytes
+                if (job.expectedLength >= 0 || bodyLength >= 0) {
+                    uint32_t known = job.expectedLength >= 0 ? job.expectedLength : job.startOffset + bodyLength;
+                    updateBatchShare(*job.request, known, job.startOffset, true);
+                }
+
+                if (job.expectedLength == 0) { // Handle 0-byte files explicitly
+                     publishDownloadProgress(fileNumber, 100);
+                }
+                preconnectNextJob();
+
+#if SEGMENTED_DOWNLOAD
+                segmented = segmentable && encoding == CONTENT_ENCODING_IDENTITY &&
+                            httpCode == HTTP_CODE_PARTIAL_CONTENT && bodyLength > 0 && job.etag[0] != '\0' &&
+                            job.startOffset + bodyLength < (uint32_t)job.expectedLength;
+                if (segmented) {
+                    xSemaphoreTake(segmentLock, portMAX_DELAY);
+                    segmentedJob.url = url;
+                    segmentedJob.jobId = jobId;
+                    segmentedJob.fileNumber = fileNumber;
+                    segmentedJob.nextOffset = job.startOffset + bodyLength;
+                    segmentedJob.endOffset = job.expectedLength;
+                    segmentedJob.failed = false;
+                    // Open the file before any other lane can queue a SEGMENT marker
+                    ChunkDescriptor marker = { CHUNK_NO_BUFFER, CHUNK_FLAG_FIRST | CHUNK_FLAG_SEGMENT, 0, jobId, 0, job.startOffset };
+                    bool opened = sendChunk(marker);
+                    xSemaphoreGive(segmentLock);
+                    if (opened) {
+                        firstChunkPending = false;
+                        for (int i = 0; i < SEGMENT_CONNECTIONS - 1; i++) xTaskNotifyGive(segmentTaskHandles[i]);
+                    } else {
+                        segmented = false;
+                    }
+                }
+#endif
+                if (encoding == CONTENT_ENCODING_UNKNOWN) {
+                    Serial.printf("[DownloadTask] Unsupported Content-Encoding '%s' for %s\n", contentEncoding.c_str(), extractedFilename);
+                    result = DOWNLOAD_FAILED;
+                } else if (encoding != CONTENT_ENCODING_IDENTITY && (encoding != job.encoding || httpCode != HTTP_CODE_OK)) {
+                    // Learned from the header, or the body is a range of compressed data: start over
+                    // from byte 0 with a decoder taken before the request
+                    Serial.printf("[DownloadTask] %s is %s-encoded, restarting it as a compressed download.\n",
+                                  extractedFilename, contentEncoding.c_str());
+                    job.encoding = encoding;
+                    job.startOffset = 0;
+                } else if (decoder) {
+                    result = streamDecodedBody(http, clientSecure, jobId, bodyLength, decoder, firstChunkPending, fileNumber);
+                } else {
+                    // Segmented jobs run to completion: their other lanes cannot stop at one boundary.
+                    // A bundle could only restart from byte 0, so it is never preempted either.
+                    bool preemptible = job.priority == JOB_PRIORITY_BULK && !segmented && jobIsResumable(job);
+                    result = streamBody(http, clientSecure, jobId, 0, job.startOffset, bodyLength, firstChunkPending, fileNumber, preemptible);
+                }
+
+            } else if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+                Serial.printf("[DownloadTask] %s is unchanged, keeping the copy on the card.\n", extractedFilename);
+                firstChunkPending = false; // The end marker must not create an empty file over it
+                publishDownloadProgress(fileNumber, 100);
+                result = DOWNLOAD_OK;
+            } else { // HTTP code not OK
+                Serial.printf("[DownloadTask] HTTP GET failed for %s, Code: %d\n", extractedFilename, httpCode);
+                String errorPayload = http.getString(); // Get error body if any
+                Serial.printf("[DownloadTask] HTTP Error Body: %s\n", errorPayload.c_str());
+                if (httpCode == HTTP_CODE_RANGE_NOT_SATISFIABLE && job.startOffset == 0) {
+                    job.expectedLength = 0; // Nothing at byte 0: the object is empty
+                    result = DOWNLOAD_OK;
+                } else if (httpCode == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+                    job.startOffset = 0; // Stale journal: start over
+                    job.etag[0] = '\0';
+                } else if (httpCode < 500 && httpCode != 408 && httpCode != 429) {
+                    result = DOWNLOAD_FAILED;
+                }
             }
+        } else { // http.GET() returned error (e.g., -1 to -11)
+            Serial.printf("[DownloadTask] HTTP GET failed for %s, Client Error: %d (%s)\n",
+                          extractedFilename, httpCode, http.errorToString(httpCode).c_str());
+        }
+        http.end();
+        // Only a fully read response leaves the connection fit for the next request
+        releaseConnection(clientSecure, result == DOWNLOAD_OK);
 
-            // Always send a final "isLast" marker chunk for THIS FILE to the write task
-            FileChunk lastMarker;
-            lastMarker.length = 0;
-            lastMarker.isLast = true;
-            // If it was a 0-byte file and no data chunks were sent, set filename in marker
-            if (downloadSuccessful && totalBytesExpected == 0 && !firstDataChunkSent) {
-                strncpy(lastMarker.filename, extractedFilename, sizeof(lastMarker.filename) - 1);
-                lastMarker.filename[sizeof(lastMarker.filename) - 1] = '\0';
-            } else {
-                lastMarker.filename[0] = '\0';
+#if SEGMENTED_DOWNLOAD
+        if (segmented) {
+            // This connection becomes lane 0 for the remaining segments, then waits for the other lanes
+            if (result == DOWNLOAD_OK) fetchSegments(0);
+            else segmentedJob.failed = true;
+            for (int i = 0; i < SEGMENT_CONNECTIONS - 1; i++) xSemaphoreTake(segmentTasksIdle, portMAX_DELAY);
+            result = segmentedJob.failed ? DOWNLOAD_RETRY : DOWNLOAD_OK;
+        }
+#endif
+
+        unsigned long elapsedMillis = millis() - startMillis;
+        uint32_t receivedBytes = job.receivedBytes;
+        Serial.printf("[DownloadTask] End URL processing for %s: %lu bytes in %lu ms (%lu KB/s, %s, first byte after %lu ms). Free Heap: %u, Min Free Heap: %u\n",
+            extractedFilename,
+            (unsigned long)receivedBytes, elapsedMillis,
+            (unsigned long)(elapsedMillis ? (uint64_t)receivedBytes * 1000 / 1024 / elapsedMillis : 0),
+            segmented ? "segmented" : "single stream", firstByteMillis,
+            (unsigned int)ESP.getFreeHeap(),
+            (unsigned int)ESP.getMinFreeHeap());
+    } else {
+        Serial.printf("[DownloadTask] HTTP Begin FAILED for %s.\n", extractedFilename);
+        releaseConnection(clientSecure, false);
+    }
+    releaseStreamDecoder(decoder);
+
+    // Always send a final end-of-job marker for THIS ATTEMPT to the write task.
+    // A successful 0-byte file has no data chunks, so its marker also carries FIRST.
+    uint8_t markerFlags = (result == DOWNLOAD_OK) ? 0 : CHUNK_FLAG_FAILED;
+    if (result == DOWNLOAD_OK && firstChunkPending) markerFlags |= CHUNK_FLAG_FIRST;
+    sendJobEndMarker(jobId, markerFlags, extractedFilename);
+#if SEGMENTED_DOWNLOAD
+    // Released after the end marker so writeTask has flushed this job's lanes before another job uses them
+    if (segmentable) xSemaphoreGive(segmentLanesOwner);
+#endif
+    return result;
+}
+
+// --- Download Workers (Core 0) ---
+// DOWNLOAD_WORKER_COUNT instances share the job scheduler; the worker number is the task parameter.
+void downloadTask(void* pvParameters) {
+    uint8_t worker = (uint8_t)(uintptr_t)pvParameters;
+    Serial.printf("[DownloadTask] Worker %u started.\n", worker);
+    while (!jobsPending || !chunkQueue || !freeJobQueue) {
+        Serial.println("[DownloadTask] Waiting for queues to be initialized...");
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+
+    DownloadRequest request;
+    bool preempted = false; // `request` holds a preempted job to hand back to the scheduler
+
+    for (;;) {
+        if (!preempted && !workerMayTakeJob(worker)) {
+            vTaskDelay(pdMS_TO_TICKS(WORKER_IDLE_POLL_MS)); // Parked by adaptConcurrency()
+            continue;
+        }
+        if (takeNextJob(request, preempted, pdMS_TO_TICKS(WORKER_IDLE_POLL_MS))) {
+            preempted = false;
+            int fileNumber = ++fileDownloadAttemptCounter;
+            unsigned long jobStartMillis = millis();
+            uint8_t slot;
+            xQueueReceive(freeJobQueue, &slot, portMAX_DELAY); // Waits only while writeTask drains earlier jobs
+            uint16_t jobId = slot;
+            JobInfo& job = jobInfoFor(jobId);
+            job.owner = xTaskGetCurrentTaskHandle();
+            job.request = &request;
+            Serial.printf("[DownloadTask] Worker %u processing URL #%d: %s\n", worker, fileNumber, jobUrl(request));
+
+            extractFilename(jobUrl(request), job.filename, sizeof(job.filename));
+            strcpy(job.s3Key, jobKey(request));
+            job.priority = request.priority;
+            job.encoding = request.encoding;
+            job.container = request.container;
+            strcpy(job.etag, arenaRecord(request.record)->etag);
+            job.expectedLength = request.expectedLength;
+            // A preempted job continues where it stopped; anything else may have a journal
+            job.startOffset = request.resumeOffset > 0 ? request.resumeOffset : resumeOffsetFromJournal(job);
+            if (!jobIsResumable(job)) job.startOffset = 0;
+            job.cachedEtag[0] = '\0';
+            Serial.printf("[DownloadTask] Target filename: %s\n", job.filename);
+
+            DownloadResult result = DOWNLOAD_RETRY;
+            if (job.startOffset == 0 && job.container == JOB_CONTAINER_NONE && isUnchangedOnCard(job)) {
+                Serial.printf("[DownloadTask] %s is already on the card at ETag %s, skipping.\n", job.filename, job.etag);
+                publishDownloadProgress(fileNumber, 100);
+                result = DOWNLOAD_OK; // writeTask never sees the job
             }
+            for (int attempt = 1; attempt <= DOWNLOAD_MAX_ATTEMPTS && result == DOWNLOAD_RETRY; attempt++) {
+                if (attempt > 1) {
+                    vTaskDelay(pdMS_TO_TICKS(DOWNLOAD_RETRY_DELAY_MS * (attempt - 1)));
+                    Serial.printf("[DownloadTask] Retry %d/%d for %s from byte %lu\n",
+                                  attempt, DOWNLOAD_MAX_ATTEMPTS, job.filename, (unsigned long)job.startOffset);
+                }
+                ulTaskNotifyTake(pdTRUE, 0); // Drop any stale commit notification
+                result = downloadAttempt(jobUrl(request), jobId, job, fileNumber);
 
-            if (xQueueSend(chunkQueue, &lastMarker, pdMS_TO_TICKS(5000)) != pdPASS) {
-                Serial.printf("[DownloadTask] CRITICAL: Failed to send LAST CHUNK marker for %s!\n", extractedFilename);
-            } else {
-                Serial.printf("[DownloadTask] Sent LAST CHUNK marker for %s.\n", extractedFilename);
+                // Wait until writeTask has committed this attempt, so the next one resumes from durable
+                // data and a file the card did not take is not counted as downloaded
+                if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOB_COMMIT_TIMEOUT_MS)) == 0) {
+                    Serial.printf("[DownloadTask] writeTask did not commit %s, giving up.\n", job.filename);
+                    result = DOWNLOAD_FAILED;
+                } else if (job.writeFailed) {
+                    // Only the journaled part of the file is known to be on the card
+                    Serial.printf("[DownloadTask] The card did not take %s.\n", job.filename);
+                    if (result == DOWNLOAD_OK) result = DOWNLOAD_RETRY;
+                    job.startOffset = jobIsResumable(job) ? resumeOffsetFromJournal(job) : 0;
+                } else if (result != DOWNLOAD_OK) {
+                    job.startOffset = jobIsResumable(job) ? job.committedBytes : 0;
+                }
             }
 
-            if (downloadSuccessful) {
-                Serial.printf("[DownloadTask] Successfully processed download for %s.\n", extractedFilename);
+            if (result == DOWNLOAD_OK) {
+                Serial.printf("[DownloadTask] Successfully processed download for %s.\n", jobKey(request));
+                uint32_t latencyMs = millis() - jobStartMillis;
+                fileLatencyTotalMs += latencyMs;
+                raiseToAtLeast(fileLatencyMaxMs, latencyMs);
+                filesCompleted++;
+                // Skipped and unchanged files count as transferred
+                uint32_t batchBytes = std::max(request.batchKnownBytes, request.batchTransferredBytes);
+                updateBatchShare(request, batchBytes, batchBytes, true);
+                finishBatchFile(request.batch, false);
+                releaseJobSlot(jobId);
+                releaseJobRecord(request);
+            } else if (result == DOWNLOAD_PREEMPTED) {
+                // Resuming needs the ETag to make sure the object has not changed in between
+                request.resumeOffset = job.etag[0] != '\0' ? job.startOffset : 0;
+                request.expectedLength = job.expectedLength;
+                strcpy(arenaRecord(request.record)->etag, job.etag); // The record is this worker's until requeued
+                preempted = true; // Requeued by takeNextJob() on the next pass
+                Serial.printf("[DownloadTask] %s preempted at byte %lu.\n", job.filename, (unsigned long)request.resumeOffset);
+                releaseJobSlot(jobId);
             } else {
-                Serial.printf("[DownloadTask] FAILED to download %s.\n", extractedFilename);
+                Serial.printf("[DownloadTask] FAILED to download %s.\n", job.filename);
+                filesFailed++;
+                updateBatchShare(request, request.batchTransferredBytes, request.batchTransferredBytes, true);
+                finishBatchFile(request.batch, true);
+                releaseJobSlot(jobId); // writeTask is done with it: the last attempt has been committed
+                releaseJobRecord(request);
             }
-        } // if xQueueReceive
+            adaptConcurrency();
+        } // if takeNextJob
         vTaskDelay(pdMS_TO_TICKS(10)); // Small delay if queue is empty
     } // for(;;)
 }
 
 
 // --- Write Task (Core 1) ---
+// Gathers chunk data into WRITE_COALESCE_SIZE blocks so FATFS only sees whole-sector writes
+// aligned to file offsets (except the tail at end of file), instead of one write per chunk.
+// Each download lane has its own writer, since segmented lanes fill different parts of the file.
+struct CoalescingWriter {
+    File* file;
+    uint8_t* buffer;
+    size_t fill;          // Bytes currently buffered
+    uint32_t fileOffset;  // File offset of buffer[0]; everything before it in the lane's range is written
+    bool active;          // The lane has a byte range in the current job
+};
+
+// writeTask state for one job slot. Descriptors of concurrent jobs interleave, so every slot
+// keeps its own open file and writers.
+// Where writeTask is in a tar bundle. Entries are written as their data streams past.
+#define TAR_BLOCK_SIZE 512
+struct BundleSplitter {
+    uint8_t header[TAR_BLOCK_SIZE];
+    uint16_t headerFill;
+    uint16_t paddingRemaining;  // Up to the next block boundary after an entry's data
+    uint32_t entryRemaining;    // Data bytes of the current entry still to come
+    uint32_t entryOffset;
+    bool entryOpen;             // Writing the current entry to the job's file
+    bool ended;                 // Past the end-of-archive block
+    uint16_t filesWritten;
+};
+
+struct OutputFile {
+    File file;
+    CoalescingWriter lanes[DOWNLOAD_LANE_COUNT];
+    char path[128];
+    bool isOpen;
+    bool isDiscarding;          // Dropping the job's descriptors until its end marker
+    bool isJournaled;           // Large files get an on-card journal so they can resume
+    bool isBundle;              // A tar bundle: `file` is the entry being written, if any
+    bool crcValid;              // `crc` covers everything written so far
+    uint32_t crc;               // CRC-32 of the file (or bundle entry) for the sample index
+    uint32_t crcOffset;         // Bytes covered by `crc`
+    uint32_t lastJournalOffset;
+    bool isPreallocated;        // Extended to its final size before the data was written
+    uint32_t accountedSize;     // Size the free-space tracker has counted for the file
+    BundleSplitter bundle;
+};
+
+static OutputFile outputFiles[JOB_SLOT_COUNT];
+static std::atomic<bool> cardWriteActive(false); // Read by the SD presence probe
+static std::atomic<bool> dropOutputsRequested(false);
+static_assert((JOB_SLOT_COUNT + DOWNLOAD_LANE_COUNT - 1) * WRITE_COALESCE_SIZE <= WRITE_COALESCE_BUDGET,
+              "Write buffers exceed WRITE_COALESCE_BUDGET: lower WRITE_COALESCE_SIZE, DOWNLOAD_WORKER_COUNT or SEGMENT_CONNECTIONS");
+static uint8_t coalesceBuffers[JOB_SLOT_COUNT][WRITE_COALESCE_SIZE];
+#if SEGMENTED_DOWNLOAD
+static uint8_t segmentCoalesceBuffers[SEGMENT_CONNECTIONS - 1][WRITE_COALESCE_SIZE];
+#endif
+
+static uint8_t* coalesceBufferFor(uint16_t jobId, uint8_t lane) {
+#if SEGMENTED_DOWNLOAD
+    // Only one job at a time owns the segment lanes, so their buffers are shared by all slots
+    if (lane > 0) return segmentCoalesceBuffers[lane - 1];
+#endif
+    return coalesceBuffers[jobId];
+}
+
+static void coalescerReset(CoalescingWriter& writer, uint8_t* buffer, File* file, uint32_t fileOffset) {
+    writer.file = file;
+    writer.buffer = buffer;
+    writer.fill = 0;
+    writer.fileOffset = fileOffset;
+    writer.active = false;
+}
+
+// --- Pipeline Depth ---
+// Latencies of recent SD block writes; only touched by writeTask
+static uint16_t sdWriteLatencyMs[SD_LATENCY_WINDOW];
+static uint8_t sdLatencyNext = 0;
+static uint8_t sdLatencyCount = 0;
+
+static void recordSdWriteLatency(unsigned long latencyMs) {
+    sdWriteLatencyMs[sdLatencyNext] = latencyMs > UINT16_MAX ? UINT16_MAX : latencyMs;
+    sdLatencyNext = (sdLatencyNext + 1) % SD_LATENCY_WINDOW;
+    if (sdLatencyCount < SD_LATENCY_WINDOW) sdLatencyCount++;
+}
+
+static uint16_t sdWriteLatencyPercentile() {
+    if (sdLatencyCount == 0) return 0;
+    uint16_t sorted[SD_LATENCY_WINDOW];
+    memcpy(sorted, sdWriteLatencyMs, sdLatencyCount * sizeof(uint16_t));
+    int rank = (sdLatencyCount * SD_LATENCY_PERCENTILE) / 100;
+    if (rank >= sdLatencyCount) rank = sdLatencyCount - 1;
+    std::nth_element(sorted, sorted + rank, sorted + sdLatencyCount);
+    return sorted[rank];
+}
+
+// Sets the chunk pool target to the data arriving during one SD stall: the recent write-latency
+// percentile, kept within SD_STALL_MIN_MS..SD_STALL_MAX_MS, times the network rate. The rate decays
+// slowly so a stall, which also stops arrivals, does not shrink the pool right after it. Without
+// arrivals the target falls back to CHUNK_POOL_SIZE and idle extra buffers are freed.
+static void adaptChunkPool() {
+    static unsigned long lastSample = 0;
+    static uint32_t lastBytes = 0;
+    static uint32_t bytesPerSecond = 0;
+    unsigned long now = millis();
+    if (now - lastSample < PIPELINE_SAMPLE_MS) return;
+
+    uint32_t bytes = totalBytesReceived;
+    uint32_t rate = (uint64_t)(bytes - lastBytes) * 1000 / (now - lastSample);
+    bool arriving = bytes != lastBytes;
+    lastSample = now;
+    lastBytes = bytes;
+    bytesPerSecond = arriving ? std::max(rate, bytesPerSecond - bytesPerSecond / 4) : 0;
+
+    int target = CHUNK_POOL_SIZE;
+    uint16_t stallMs = sdWriteLatencyPercentile();
+    if (arriving) {
+        uint32_t slackMs = std::min(std::max((uint32_t)stallMs, (uint32_t)SD_STALL_MIN_MS), (uint32_t)SD_STALL_MAX_MS);
+        uint32_t slackBytes = (uint64_t)bytesPerSecond * slackMs / 1000;
+        target = std::min<int>(CHUNK_POOL_SIZE + (slackBytes + CHUNK_SIZE - 1) / CHUNK_SIZE, chunkPoolLimit);
+    }
+    if (target != chunkPoolTarget) {
+        Serial.printf("[WriteTask] Chunk pool target %d -> %d buffers (%lu B/s, p%d SD write %u ms)\n",
+                      (int)chunkPoolTarget, target, (unsigned long)bytesPerSecond, SD_LATENCY_PERCENTILE, stallMs);
+        chunkPoolTarget = target;
+    }
+
+    // Extra buffers in use are freed as writeTask returns them; idle ones are freed here
+    for (UBaseType_t n = uxQueueMessagesWaiting(freeChunkQueue); n > 0 && chunkBuffersAllocated > chunkPoolTarget; n--) {
+        uint8_t bufferIndex;
+        if (xQueueReceive(freeChunkQueue, &bufferIndex, 0) != pdTRUE) break;
+        if (!trimChunkBuffer(bufferIndex)) xQueueSend(freeChunkQueue, &bufferIndex, 0);
+    }
+}
+
+// Writes out whatever is buffered. Returns false if the file accepted fewer bytes.
+static bool coalescerFlush(CoalescingWriter& writer) {
+    if (writer.fill == 0) return true;
+    if (writer.file->position() != writer.fileOffset && !writer.file->seek(writer.fileOffset)) {
+        writer.fill = 0;
+        return false;
+    }
+    uint32_t startUs = micros();
+    size_t written = writer.file->write(writer.buffer, writer.fill);
+    uint32_t elapsedUs = micros() - startUs;
+    recordStageLatency(STAGE_SD_WRITE, elapsedUs);
+    recordSdWriteLatency(elapsedUs / 1000);
+    totalBytesWritten += written;
+    writer.fileOffset += written;
+    bool ok = (written == writer.fill);
+    writer.fill = 0;
+    return ok;
+}
+
+static bool coalescerAppend(CoalescingWriter& writer, uint32_t offset, const uint8_t* data, size_t length) {
+    if (offset != writer.fileOffset + writer.fill) {
+        // Not contiguous with the buffered data: the lane moved to another range
+        if (!coalescerFlush(writer)) return false;
+        writer.fileOffset = offset;
+    }
+    while (length > 0) {
+        // Fill only up to the next WRITE_COALESCE_SIZE boundary in the file
+        size_t target = WRITE_COALESCE_SIZE - (writer.fileOffset % WRITE_COALESCE_SIZE);
+        size_t n = target - writer.fill;
+        if (n > length) n = length;
+        memcpy(writer.buffer + writer.fill, data, n);
+        writer.fill += n;
+        data += n;
+        length -= n;
+        if (writer.fill == target && !coalescerFlush(writer)) return false;
+    }
+    return true;
+}
+
+// Everything below the lowest active lane's written offset is on the card: segments are handed
+// out in offset order and a lane only moves on once its segment is complete.
+static uint32_t committedOffset(const CoalescingWriter* lanes, uint32_t startOffset) {
+    uint32_t committed = UINT32_MAX;
+    for (int i = 0; i < DOWNLOAD_LANE_COUNT; i++) {
+        if (lanes[i].active && lanes[i].fileOffset < committed) committed = lanes[i].fileOffset;
+    }
+    return committed == UINT32_MAX ? startOffset : committed;
+}
+
+static bool flushAllLanes(CoalescingWriter* lanes) {
+    bool ok = true;
+    for (int i = 0; i < DOWNLOAD_LANE_COUNT; i++) {
+        if (!coalescerFlush(lanes[i])) ok = false;
+    }
+    return ok;
+}
+
+// Reports how much of an attempt is safely on the card, so the worker can resume from there, and
+// whether the card failed to take the data, so the worker retries instead of counting the file
+static void signalJobCommitted(uint16_t jobId, uint32_t committedBytes, bool writeFailed) {
+    JobInfo& job = jobInfoFor(jobId);
+    job.committedBytes = committedBytes;
+    job.writeFailed = writeFailed;
+    if (job.owner) xTaskNotifyGive(job.owner);
+}
+
+// Called once per end-of-job marker, after writeTask's last use of the job's slot.
+// written is false if the file could not be opened, written or committed, or the card went away.
+static void finishJob(const ChunkDescriptor& marker, uint32_t committedBytes, bool written) {
+    signalJobCommitted(marker.jobId, committedBytes, !written);
+}
+
+// Flushes the file to the card, then records how far it got in the job's journal
+static void commitJournal(File& file, const JobInfo& job, uint32_t committedBytes) {
+    file.flush();
+    DownloadJournal journal;
+    memset(&journal, 0, sizeof(journal));
+    journal.expectedLength = job.expectedLength;
+    journal.committedBytes = committedBytes;
+    strncpy(journal.s3Key, job.s3Key, sizeof(journal.s3Key) - 1);
+    strncpy(journal.etag, job.etag, sizeof(journal.etag) - 1);
+    if (!saveDownloadJournal(job.filename, journal)) {
+        Serial.printf("[WriteTask] Failed to update journal for %s\n", job.filename);
+    }
+}
+
+// Drops this descriptor and every later one of the same job, returning their buffers
+static void discardRestOfJob(OutputFile& out, const ChunkDescriptor& chunk) {
+    releaseChunkBuffer(chunk);
+    if (chunk.flags & CHUNK_FLAG_LAST) {
+        out.isDiscarding = false;
+        finishJob(chunk, 0, false); // Nothing usable kept
+    } else {
+        out.isDiscarding = true;
+    }
+}
+
+// SD_CARD.open and close in the write path, timed for the stage histograms
+static File openTimed(const char* path, const char* mode) {
+    uint32_t startUs = micros();
+    File file = SD_CARD.open(path, mode);
+    recordStageLatency(STAGE_SD_OPEN, micros() - startUs);
+    return file;
+}
+
+static void closeTimed(File& file) {
+    uint32_t startUs = micros();
+    file.close();
+    recordStageLatency(STAGE_SD_CLOSE, micros() - startUs);
+}
+
+// Tells the free-space tracker that the output file is now `size` bytes long
+static void accountFileSize(OutputFile& out, uint32_t size) {
+    noteFileResized(out.accountedSize, size);
+    out.accountedSize = size;
+}
+
+// Moves a complete file from STAGING_DIRECTORY over its name in SAMPLE_DIRECTORY
+static bool commitStagedFile(const char* stagedPath, const char* filename) {
+    char finalPath[128];
+    snprintf(finalPath, sizeof(finalPath), "%s/%s", SAMPLE_DIRECTORY, filename);
+    StorageStat previous;
+    if (storage().stat(finalPath, previous) && SD_CARD.remove(finalPath)) { // FATFS does not rename over an existing file
+        noteFileResized(previous.size, 0);
+    }
+    if (!SD_CARD.rename(stagedPath, finalPath)) {
+        Serial.printf("[WriteTask] Could not move %s to %s!\n", stagedPath, finalPath);
+        return false;
+    }
+    return true;
+}
+
+// Extends a file to its final size in one step, before any data is written. FATFS then takes the
+// clusters in one run from the free space instead of interleaving them with the other files
+// being written, and the writes that follow no longer update the FAT at every cluster boundary.
+// The file position is left at `offset`.
+static bool preallocateFile(File& file, const char* path, uint32_t size, uint32_t offset) {
+    if (size <= file.size()) return false;
+    unsigned long startMillis = millis();
+    uint8_t lastByte = 0;
+    // Seeking past the end in write mode makes FATFS allocate the clusters without writing them
+    if (!file.seek(size - 1) || file.write(&lastByte, 1) != 1) {
+        Serial.printf("[WriteTask] Could not preallocate %lu bytes for %s\n", (unsigned long)size, path);
+        file.seek(offset);
+        return false;
+    }
+    file.flush();
+    file.seek(offset);
+    Serial.printf("[WriteTask] Preallocated %lu bytes for %s in %lu ms\n", (unsigned long)size, path, millis() - startMillis);
+    return true;
+}
+
+// Cuts a preallocated file that did not complete back to the bytes it really holds, so the
+// SP-404SX never sees the unwritten tail
+static void trimPreallocatedFile(const char* path, uint32_t length) {
+    if (!storage().truncate(path, length)) {
+        Serial.printf("[WriteTask] Could not trim %s to %lu bytes\n", path, (unsigned long)length);
+    }
+}
+
+// Extends the running CRC while data arrives in file order. Resumed and segmented downloads
+// write out of order and end up without one.
+static void updateFileCrc(OutputFile& out, uint32_t offset, const uint8_t* data, size_t length) {
+    if (!out.crcValid) return;
+    if (offset != out.crcOffset) {
+        out.crcValid = false;
+        return;
+    }
+    out.crc = crc32_le(out.crc, data, length);
+    out.crcOffset += length;
+}
+
+static void resetFileCrc(OutputFile& out, bool fromStart) {
+    out.crcValid = fromStart;
+    out.crc = 0;
+    out.crcOffset = 0;
+}
+
+// Adds a completed file to the sample index
+static void indexWrittenFile(const OutputFile& out, const char* filename, const char* s3Key, const char* etag, uint32_t size) {
+    SampleRecord record;
+    memset(&record, 0, sizeof(record));
+    strncpy(record.filename, filename, sizeof(record.filename) - 1);
+    strncpy(record.s3Key, s3Key, sizeof(record.s3Key) - 1);
+    strncpy(record.etag, etag, sizeof(record.etag) - 1);
+    record.size = size;
+    if (out.crcValid && out.crcOffset == size) {
+        record.flags |= SAMPLE_FLAG_CRC;
+        record.crc32 = out.crc;
+    }
+    recordSample(record);
+}
+
+// Gives a card that was just inserted a moment to be mounted. False if it is still gone.
+static bool ensureCardPresent(const char* filename) {
+    if (isSDCardReady()) return true;
+    Serial.println("[WriteTask] SD card not present! Waiting for it...");
+    vTaskDelay(pdMS_TO_TICKS(500)); // The main loop mounts it on insertion
+    if (!isSDCardReady()) {
+        Serial.printf("[WriteTask] SD still not present. Skipping file: %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+// --- Bundle Splitting ---
+// A bundle is one tar (ustar) object holding a batch of samples. Its regular files are staged
+// under their base names as the stream passes through and moved into SAMPLE_DIRECTORY as each one
+// completes; directories, links and pax/GNU extension records are skipped.
+
+static uint32_t parseOctal(const uint8_t* field, size_t length) {
+    uint32_t value = 0;
+    size_t i = 0;
+    while (i < length && field[i] == ' ') i++; // Older tars pad with leading spaces
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+static bool closeBundleEntry(OutputFile& out, uint16_t jobId, bool complete) {
+    BundleSplitter& bundle = out.bundle;
+    if (!bundle.entryOpen) return true;
+    bool ok = coalescerFlush(out.lanes[0]);
+    closeTimed(out.file);
+    bundle.entryOpen = false;
+    const char* entryName = strrchr(out.path, '/') + 1;
+    if (complete && ok && commitStagedFile(out.path, entryName)) {
+        accountFileSize(out, bundle.entryOffset);
+        bundle.filesWritten++;
+        // The bundle's ETag says nothing about a single entry, so none is recorded
+        indexWrittenFile(out, entryName, jobInfoFor(jobId).s3Key, "", bundle.entryOffset);
+        Serial.printf("[WriteTask] Bundle entry written: %s/%s (%lu bytes)\n", SAMPLE_DIRECTORY, entryName,
+                      (unsigned long)bundle.entryOffset);
+    } else {
+        if (SD_CARD.remove(out.path)) accountFileSize(out, 0); // Bundles always restart from byte 0, so a partial entry is of no use
+    }
+    out.isPreallocated = false;
+    return ok;
+}
+
+// Handles a complete header block. False if the bundle is corrupt or the entry cannot be created.
+static bool startBundleEntry(OutputFile& out, uint16_t jobId) {
+    BundleSplitter& bundle = out.bundle;
+    const uint8_t* header = bundle.header;
+    uint32_t checksum = 0;
+    bool empty = true;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        checksum += (i >= 148 && i < 156) ? ' ' : header[i]; // The checksum field counts as spaces
+        if (header[i] != 0) empty = false;
+    }
+    if (empty) {
+        bundle.ended = true;
+        return true;
+    }
+    if (checksum != parseOctal(header + 148, 8)) {
+        Serial.println("[WriteTask] Bundle header checksum mismatch!");
+        return false;
+    }
+
+    bundle.entryRemaining = parseOctal(header + 124, 12);
+    bundle.paddingRemaining = (TAR_BLOCK_SIZE - bundle.entryRemaining % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    bundle.entryOffset = 0;
+    char type = header[156];
+    if (type != '0' && type != '\0') return true; // Not a regular file: skip its data
+
+    char name[101];
+    memcpy(name, header, 100);
+    name[100] = '\0';
+    const char* baseName = strrchr(name, '/');
+    baseName = baseName ? baseName + 1 : name;
+    if (baseName[0] == '\0' || baseName[0] == '.' || strlen(baseName) >= FILENAME_MAX_LENGTH) {
+        Serial.printf("[WriteTask] Skipping bundle entry '%s'\n", name);
+        return true;
+    }
+    snprintf(out.path, sizeof(out.path), "%s/%s", STAGING_DIRECTORY, baseName);
+    out.file = openTimed(out.path, FILE_WRITE);
+    if (!out.file) {
+        Serial.printf("[WriteTask] Failed to open %s for writing!\n", out.path);
+        return false;
+    }
+    coalescerReset(out.lanes[0], coalesceBufferFor(jobId, 0), &out.file, 0);
+    resetFileCrc(out, true);
+    out.accountedSize = 0;
+    out.isPreallocated = preallocateFile(out.file, out.path, bundle.entryRemaining, 0);
+    if (out.isPreallocated) accountFileSize(out, bundle.entryRemaining);
+    bundle.entryOpen = true;
+    if (bundle.entryRemaining == 0) return closeBundleEntry(out, jobId, true);
+    return true;
+}
+
+// Feeds bundle data through the splitter. False on a write error or a corrupt bundle.
+static bool appendToBundle(OutputFile& out, uint16_t jobId, const uint8_t* data, size_t length) {
+    BundleSplitter& bundle = out.bundle;
+    while (length > 0) {
+        size_t n;
+        if (bundle.entryRemaining > 0) {
+            n = std::min((size_t)bundle.entryRemaining, length);
+            if (bundle.entryOpen) {
+                if (!coalescerAppend(out.lanes[0], bundle.entryOffset, data, n)) return false;
+                updateFileCrc(out, bundle.entryOffset, data, n);
+            }
+            bundle.entryOffset += n;
+            bundle.entryRemaining -= n;
+            if (bundle.entryRemaining == 0 && !closeBundleEntry(out, jobId, true)) return false;
+        } else if (bundle.paddingRemaining > 0) {
+            n = std::min((size_t)bundle.paddingRemaining, length);
+            bundle.paddingRemaining -= n;
+        } else if (bundle.ended) {
+            n = length; // Trailing zero blocks
+        } else {
+            n = std::min((size_t)(TAR_BLOCK_SIZE - bundle.headerFill), length);
+            memcpy(bundle.header + bundle.headerFill, data, n);
+            bundle.headerFill += n;
+            if (bundle.headerFill == TAR_BLOCK_SIZE) {
+                bundle.headerFill = 0;
+                if (!startBundleEntry(out, jobId)) return false;
+            }
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Creates the directories files are written to and removes staged files that cannot resume:
+// those without a journal were cut off by a reset or card removal before completing.
+void prepareStagingDirectory() {
+    SD_CARD.mkdir("/ROLAND");
+    SD_CARD.mkdir("/ROLAND/SP-404SX");
+    SD_CARD.mkdir(SAMPLE_DIRECTORY);
+    SD_CARD.mkdir(SPCLOUD_DIRECTORY);
+    SD_CARD.mkdir(STAGING_DIRECTORY);
+
+    File staging = SD_CARD.open(STAGING_DIRECTORY);
+    if (!staging || !staging.isDirectory()) return;
+    int removed = 0;
+    char path[128];
+    DownloadJournal journal;
+    for (File entry = staging.openNextFile(); entry; entry = staging.openNextFile()) {
+        const char* name = strrchr(entry.name(), '/');
+        name = name ? name + 1 : entry.name();
+        snprintf(path, sizeof(path), "%s/%s", STAGING_DIRECTORY, name);
+        bool orphaned = !entry.isDirectory() && !loadDownloadJournal(name, journal);
+        entry.close();
+        if (orphaned && SD_CARD.remove(path)) removed++;
+    }
+    staging.close();
+    if (removed > 0) Serial.printf("[FileHandler] Removed %d incomplete staged file(s).\n", removed);
+}
+
+static bool anyOutputFileOpen() {
+    for (int slot = 0; slot < JOB_SLOT_COUNT; slot++) {
+        if (outputFiles[slot].isOpen) return true;
+    }
+    return false;
+}
+
+bool isCardWriteInProgress() {
+    return cardWriteActive;
+}
+
+void dropOpenOutputFiles() {
+    dropOutputsRequested = true;
+}
+
+// The card is gone: nothing in the open files can be committed. Each job's remaining descriptors
+// are discarded up to its end marker, which tells the worker to retry from the journal.
+static void dropOutputFiles() {
+    for (int slot = 0; slot < JOB_SLOT_COUNT; slot++) {
+        OutputFile& out = outputFiles[slot];
+        if (!out.isOpen) continue;
+        if (out.file) closeTimed(out.file);
+        Serial.printf("[WriteTask] Card removed, dropped %s\n", out.path[0] ? out.path : jobInfoFor(slot).filename);
+        for (uint8_t i = 0; i < DOWNLOAD_LANE_COUNT; i++) out.lanes[i].fill = 0;
+        out.bundle.entryOpen = false;
+        out.isOpen = false;
+        out.isBundle = false;
+        out.isPreallocated = false;
+        out.isDiscarding = true;
+        out.path[0] = '\0';
+    }
+}
+
 void writeTask(void* pvParameters) {
     Serial.println("[WriteTask] Started.");
     while (!chunkQueue) {
@@ -277,93 +1977,213 @@ void writeTask(void* pvParameters) {
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
 
-    const char* baseWavDirectory = "/ROLAND/SP-404SX/SMPL"; // Base directory
-    File currentOutFile;
-    char currentFilePath[128] = {0};
-    bool isFileOpen = false;
-    unsigned long totalBytesWrittenForCurrentFile = 0;
-
     for (;;) {
-        FileChunk chunk;
-        if (xQueueReceive(chunkQueue, &chunk, portMAX_DELAY) == pdTRUE) {
-            if (!isFileOpen && chunk.filename[0] != '\0' && !chunk.isLast) {
-                // This is the first data chunk for a new file
-                if (SD.cardType() == CARD_NONE) {
-                    Serial.println("[WriteTask] SD card not present! Attempting to re-init SD...");
-                    if (!SD.begin(/* pass CS pin if not default */)) { // Attempt to re-initialize
-                         Serial.println("[WriteTask] SD.begin() failed on re-attempt.");
-                    }
-                    vTaskDelay(pdMS_TO_TICKS(500)); 
-                    if (SD.cardType() == CARD_NONE) {
-                        Serial.printf("[WriteTask] SD still not present. Skipping file: %s\n", chunk.filename);
-                        // Drain any subsequent chunks for this phantom file until its 'isLast' marker
-                        while (!chunk.isLast) { if (xQueueReceive(chunkQueue, &chunk, pdMS_TO_TICKS(100)) != pdTRUE) break; }
-                        continue;
+        if (dropOutputsRequested.exchange(false)) dropOutputFiles();
+        // Updated here so every path through the previous descriptor, early continues included, counts
+        cardWriteActive = anyOutputFileOpen();
+        adaptChunkPool();
+        ChunkDescriptor chunk;
+        // Wakes up while idle so adaptChunkPool() can free extra buffers
+        if (xQueueReceive(chunkQueue, &chunk, pdMS_TO_TICKS(PIPELINE_SAMPLE_MS)) == pdTRUE) {
+            cardWriteActive = true;
+            uint32_t occupancy = uxQueueMessagesWaiting(chunkQueue) + 1; // Including the one just received
+            chunkQueueSamples++;
+            chunkQueueOccupancyTotal += occupancy;
+            raiseToAtLeast(chunkQueueOccupancyMax, occupancy);
+            JobInfo& job = jobInfoFor(chunk.jobId);
+            OutputFile& out = outputFiles[chunk.jobId];
+            const char* chunkFilename = job.filename;
+
+            if (out.isDiscarding) {
+                discardRestOfJob(out, chunk);
+                continue;
+            }
+
+            if (!out.isOpen && (chunk.flags & CHUNK_FLAG_FIRST) && job.container == JOB_CONTAINER_TAR) {
+                if (!ensureCardPresent(chunkFilename)) {
+                    discardRestOfJob(out, chunk);
+                    continue;
+                }
+                memset(&out.bundle, 0, sizeof(out.bundle));
+                out.isOpen = true;
+                out.isBundle = true;
+                out.isJournaled = false;
+                Serial.printf("[WriteTask] Splitting bundle %s into %s\n", chunkFilename, SAMPLE_DIRECTORY);
+            }
+
+            if (out.isOpen && out.isBundle) {
+                bool ok = chunk.length == 0 || appendToBundle(out, chunk.jobId, chunkPool[chunk.bufferIndex], chunk.length);
+                releaseChunkBuffer(chunk);
+                chunk.bufferIndex = CHUNK_NO_BUFFER;
+                bool last = chunk.flags & CHUNK_FLAG_LAST;
+                if (!ok || last) {
+                    bool complete = ok && last && !(chunk.flags & CHUNK_FLAG_FAILED);
+                    if (!closeBundleEntry(out, chunk.jobId, complete)) ok = false;
+                    if (complete && !out.bundle.ended && (out.bundle.headerFill > 0 || out.bundle.entryRemaining > 0)) {
+                        Serial.printf("[WriteTask] Bundle %s ended mid-entry.\n", chunkFilename);
                     }
+                    Serial.printf("[WriteTask] Bundle %s: %u file(s) written.\n", chunkFilename, out.bundle.filesWritten);
+                    out.isOpen = false;
+                    out.isBundle = false;
+                    out.path[0] = '\0';
+                    // Bundles always restart from byte 0, so nothing counts as committed
+                    if (last) finishJob(chunk, 0, ok);
+                    else discardRestOfJob(out, chunk);
                 }
-                // Construct full path: ensure baseWavDirectory exists or create it
-                snprintf(currentFilePath, sizeof(currentFilePath), "%s/%s", baseWavDirectory, chunk.filename);
+                continue;
+            }
 
+            if (!out.isOpen && (chunk.flags & CHUNK_FLAG_FIRST) && !(chunk.flags & CHUNK_FLAG_LAST)) {
+                // This is the first data chunk (or first segment marker) for a new file
+                if (!ensureCardPresent(chunkFilename)) {
+                    // Drop any subsequent chunks for this phantom file until its end marker
+                    discardRestOfJob(out, chunk);
+                    continue;
+                }
+                // Written in the staging directory; any previous version stays in place until this one is complete
+                snprintf(out.path, sizeof(out.path), "%s/%s", STAGING_DIRECTORY, chunkFilename);
 
-                currentOutFile = SD.open(currentFilePath, FILE_WRITE);
-                if (!currentOutFile) {
-                    Serial.printf("[WriteTask] Failed to open %s for writing!\n", currentFilePath);
-                    // Drain subsequent chunks for this file
-                    while (!chunk.isLast) { if (xQueueReceive(chunkQueue, &chunk, pdMS_TO_TICKS(100)) != pdTRUE) break; }
+                if (job.startOffset > 0) {
+                    // Resuming: keep the committed bytes and continue right after them
+                    out.file = openTimed(out.path, "r+");
+                    if (out.file && !out.file.seek(job.startOffset)) closeTimed(out.file);
+                } else {
+                    out.file = openTimed(out.path, FILE_WRITE);
+                }
+                if (!out.file) {
+                    Serial.printf("[WriteTask] Failed to open %s for writing!\n", out.path);
+                    // Drop subsequent chunks for this file
+                    discardRestOfJob(out, chunk);
                     continue;
                 }
-                isFileOpen = true;
-                totalBytesWrittenForCurrentFile = 0;
-                Serial.printf("[WriteTask] Opened %s for writing.\n", currentFilePath);
+                out.isOpen = true;
+                out.accountedSize = out.file.size(); // A resumed partial is already counted
+                for (uint8_t i = 0; i < DOWNLOAD_LANE_COUNT; i++) {
+                    coalescerReset(out.lanes[i], coalesceBufferFor(chunk.jobId, i), &out.file, job.startOffset);
+                }
+                out.lanes[0].active = true; // Lane 0 always starts at the attempt's start offset
+                out.isJournaled = jobIsResumable(job) && job.etag[0] != '\0' && job.expectedLength >= JOURNAL_MIN_FILE_SIZE;
+                out.lastJournalOffset = job.startOffset;
+                resetFileCrc(out, job.startOffset == 0);
+                // The full size is known for plain objects; decoded ones end wherever the data does
+                out.isPreallocated = job.expectedLength > 0 &&
+                                     preallocateFile(out.file, out.path, job.expectedLength, job.startOffset);
+                if (out.isPreallocated) accountFileSize(out, job.expectedLength);
+                Serial.printf("[WriteTask] Opened %s for writing at offset %lu.\n",
+                              out.path, (unsigned long)job.startOffset);
             }
 
-            if (isFileOpen && currentOutFile) {
+            if (out.isOpen && out.file) {
+                CoalescingWriter& writer = out.lanes[chunk.lane < DOWNLOAD_LANE_COUNT ? chunk.lane : 0];
+                bool written = true;
+                if (chunk.flags & CHUNK_FLAG_SEGMENT) {
+                    written = coalescerFlush(writer);
+                    writer.fileOffset = chunk.offset;
+                    writer.active = true;
+                }
                 if (chunk.length > 0) { // It's a data chunk
-                    size_t bytesActuallyWritten = currentOutFile.write(chunk.data, chunk.length);
-                    if (bytesActuallyWritten != chunk.length) {
-                        Serial.printf("[WriteTask] Write error to %s! Wrote %u/%u bytes.\n",
-                                      currentFilePath, (unsigned int)bytesActuallyWritten, (unsigned int)chunk.length);
-                        currentOutFile.close();
-                        isFileOpen = false;
-                        // Drain subsequent chunks for this failed file
-                        while (!chunk.isLast) { if (xQueueReceive(chunkQueue, &chunk, pdMS_TO_TICKS(100)) != pdTRUE) break; }
-                        continue;
+                    written = written && coalescerAppend(writer, chunk.offset, chunkPool[chunk.bufferIndex], chunk.length);
+                    updateFileCrc(out, chunk.offset, chunkPool[chunk.bufferIndex], chunk.length);
+                    releaseChunkBuffer(chunk);
+                    chunk.bufferIndex = CHUNK_NO_BUFFER; // Already returned to the pool
+                }
+                if (!written) {
+                    Serial.printf("[WriteTask] Write error to %s at offset %lu!\n",
+                                  out.path, (unsigned long)writer.fileOffset);
+                    accountFileSize(out, out.file.size());
+                    closeTimed(out.file);
+                    out.isOpen = false;
+                    // Only the journaled part is known to be good
+                    if (out.isPreallocated) {
+                        uint32_t kept = out.isJournaled ? out.lastJournalOffset : 0;
+                        trimPreallocatedFile(out.path, kept);
+                        accountFileSize(out, kept);
+                    }
+                    // Drop subsequent chunks for this failed file
+                    discardRestOfJob(out, chunk);
+                    continue;
+                }
+                if (out.isJournaled && chunk.length > 0) {
+                    uint32_t committed = committedOffset(out.lanes, job.startOffset);
+                    if (committed > out.lastJournalOffset && committed - out.lastJournalOffset >= JOURNAL_COMMIT_INTERVAL) {
+                        commitJournal(out.file, job, committed);
+                        out.lastJournalOffset = committed;
                     }
-                    totalBytesWrittenForCurrentFile += bytesActuallyWritten;
-                    // Serial.printf("[WriteTask] Wrote %u bytes to %s.\n", (unsigned int)bytesActuallyWritten, currentFilePath);
                 }
 
-                if (chunk.isLast) { // This is the 'isLast' marker for the current file
-                    currentOutFile.close();
-                    isFileOpen = false;
-                    Serial.printf("[WriteTask] File closed: %s. Total bytes written: %lu\n",
-                                  currentFilePath, totalBytesWrittenForCurrentFile);
-                    currentFilePath[0] = '\0'; // Clear path for next file
+                if (chunk.flags & CHUNK_FLAG_LAST) { // This is the end marker for the current file
+                    bool flushed = flushAllLanes(out.lanes);
+                    if (!flushed) {
+                        Serial.printf("[WriteTask] Write error flushing tail of %s!\n", out.path);
+                    }
+                    size_t fileSize = out.file.size();
+                    uint32_t committedBytes = 0;
+                    bool written = flushed;
+                    if (chunk.flags & CHUNK_FLAG_FAILED) {
+                        // Keep the partial file so the retry (or a later batch) can resume it
+                        committedBytes = flushed ? committedOffset(out.lanes, job.startOffset) : 0;
+                        if (out.isJournaled && flushed) commitJournal(out.file, job, committedBytes);
+                        closeTimed(out.file);
+                        if (out.isPreallocated) {
+                            trimPreallocatedFile(out.path, committedBytes);
+                            fileSize = committedBytes;
+                        }
+                        accountFileSize(out, fileSize);
+                    } else {
+                        closeTimed(out.file);
+                        accountFileSize(out, fileSize);
+                        // A file whose tail could not be written stays staged for the retry to resume
+                        written = flushed && commitStagedFile(out.path, chunkFilename);
+                        if (written) {
+                            if (out.isJournaled) removeDownloadJournal(chunkFilename);
+                            indexWrittenFile(out, chunkFilename, job.s3Key, job.etag, fileSize);
+                        }
+                    }
+                    out.isOpen = false;
+                    Serial.printf("[WriteTask] File closed: %s. File size: %lu\n",
+                                  out.path, (unsigned long)fileSize);
+                    out.path[0] = '\0'; // Clear path for next file
+                    finishJob(chunk, committedBytes, written);
                 }
-            } else if (chunk.isLast && chunk.filename[0] != '\0') {
-                // This is an 'isLast' marker for a 0-byte file (filename is set, length is 0)
-                 if (SD.cardType() == CARD_NONE) {
-                    Serial.printf("[WriteTask] SD not present, cannot create 0-byte file: %s\n", chunk.filename);
+            } else if ((chunk.flags & CHUNK_FLAG_LAST) && (chunk.flags & CHUNK_FLAG_FIRST)) {
+                // This is the end marker for a 0-byte file (no data chunks were sent)
+                 if (!isSDCardReady()) {
+                    Serial.printf("[WriteTask] SD not present, cannot create 0-byte file: %s\n", chunkFilename);
+                    finishJob(chunk, 0, false);
                     continue;
                  }
-                snprintf(currentFilePath, sizeof(currentFilePath), "%s/%s", baseWavDirectory, chunk.filename);
-                currentOutFile = SD.open(currentFilePath, FILE_WRITE); // Opens for write, creates if not exists, truncates if exists
-                if (currentOutFile) {
-                    currentOutFile.close(); // Immediately close to create/truncate
-                    Serial.printf("[WriteTask] Created/truncated 0-byte file: %s\n", currentFilePath);
+                // Staged and committed like any other file, so the old version goes through noteFileResized()
+                snprintf(out.path, sizeof(out.path), "%s/%s", STAGING_DIRECTORY, chunkFilename);
+                StorageStat stale;
+                out.accountedSize = storage().stat(out.path, stale) ? stale.size : 0;
+                out.file = openTimed(out.path, FILE_WRITE); // Creates the file, or truncates a stale staged one
+                bool written = out.file;
+                if (written) {
+                    closeTimed(out.file);
+                    accountFileSize(out, 0);
+                    written = commitStagedFile(out.path, chunkFilename);
+                }
+                if (written) {
+                    Serial.printf("[WriteTask] Created 0-byte file: %s/%s\n", SAMPLE_DIRECTORY, chunkFilename);
+                    resetFileCrc(out, true);
+                    indexWrittenFile(out, chunkFilename, job.s3Key, job.etag, 0);
                 } else {
-                    Serial.printf("[WriteTask] Failed to create 0-byte file: %s\n", currentFilePath);
+                    Serial.printf("[WriteTask] Failed to create 0-byte file: %s\n", out.path);
                 }
-                currentFilePath[0] = '\0';
-            } else if (chunk.isLast) {
-                // Received an 'isLast' marker but no file was open 
-                Serial.println("[WriteTask] Received 'isLast' marker, but no file was open or being processed.");
-            } else if (!isFileOpen && chunk.length > 0) {
-                Serial.printf("[WriteTask] Received data chunk for '%s' but no file is open. Discarding.\n", chunk.filename);
-                 while (!chunk.isLast) { // Drain the rest of this file's chunks
-                    if (xQueueReceive(chunkQueue, &chunk, pdMS_TO_TICKS(100)) != pdTRUE) break;
+                out.path[0] = '\0';
+                finishJob(chunk, 0, written);
+            } else if (chunk.flags & CHUNK_FLAG_LAST) {
+                // Received an end marker but no file was open, e.g. the attempt failed before any data
+                if (chunk.flags & CHUNK_FLAG_FAILED) {
+                    Serial.println("[WriteTask] Received 'isLast' marker, but no file was open or being processed.");
+                } else {
+                    Serial.printf("[WriteTask] Nothing to write for %s.\n", chunkFilename); // Unchanged on the server
                 }
+                finishJob(chunk, job.startOffset, true);
+            } else if (!out.isOpen && chunk.length > 0) {
+                Serial.printf("[WriteTask] Received data chunk for '%s' but no file is open. Discarding.\n", chunkFilename);
+                discardRestOfJob(out, chunk); // Drop the rest of this file's chunks
             }
         } 
     } 
-}
\ No newline at end of file
+}
@@ -6,9 +6,6 @@
 
 bool isDeviceRegistered = false;
 bool receivedRegStatus = false;
-bool sdInserted = false;
-unsigned long lastSDCheck = 0;
-const unsigned long sdCheckInterval = 2000; // ms
 
 Adafruit_SSD1306 display(-1);
 WiFiClientSecure net;
@@ -48,6 +45,10 @@ void setup() {
 
   // Setup SD card
   setupSD();
+  initSDPresence();
+#if SD_WRITE_BENCHMARK
+  runSDWriteBenchmark();
+#endif
 
   // Connect to Wi-Fi and MQTT
   display.clearDisplay();
@@ -58,6 +59,9 @@ void setup() {
   display.print(WIFI_SSID);
   display.display();
   connectToWiFi();
+#if PIPELINE_BENCHMARK
+  runPipelineBenchmark(); // Measures the download pipeline before anything else uses the network
+#endif
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(28, 7);
@@ -101,10 +105,12 @@ void setup() {
   }
 
   // Publish SD info
-  if (SD.cardType() != CARD_NONE) {
+  if (isSDCardReady()) {
     publishSDStatus();
+    showReadyToUpload();
   } else {
     Serial.println("No SD card detected");
+    showSDRemoved();
   }
   
   size_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
@@ -125,64 +131,21 @@ void setup() {
 
 void loop() {
   mqttLoop();
-
-  static bool lastCardPresent = false;
-  static unsigned long lastSDQuery = 0;
-  static bool cardPresent = false;
-
-  // Only check SD card every sdCheckInterval ms
-  if (millis() - lastSDQuery > sdCheckInterval) {
-    lastSDQuery = millis();
-    File testFile = SD.open("/");
-    if (testFile) {
-      cardPresent = true;
-      testFile.close();
-    } else {
-      cardPresent = false;
-    }
-  }
-
-  // Detect SD card removal
-  if (lastCardPresent && !cardPresent) {
-    sdInserted = false;
-    showSDRemoved();
-    lastSDCheck = millis();
-  }
-
-  // Detect SD card insertion
-  if (!lastCardPresent && cardPresent) {
-    sdInserted = true;
-    showReadyToUpload();
-  }
-
-  lastCardPresent = cardPresent;
-
-  // Only try to initialize if not inserted and card is not present
-  if (!sdInserted && !cardPresent) {
-    if (millis() - lastSDCheck > sdCheckInterval) {
-      lastSDCheck = millis();
-      if (SD.begin()) {
-        File testFile2 = SD.open("/");
-        if (testFile2) {
-          cardPresent = true;
-          testFile2.close();
-        } else {
-          cardPresent = false;
-        }
-        if (cardPresent) {
-          sdInserted = true;
-          showReadyToUpload();
-        } else {
-          sdInserted = false;
-          showSDRemoved();
-        }
-      } else {
-        showSDRemoved();
-      }
-    } else {
+  publishBatchStatus();
+
+  switch (updateSDPresence()) {
+    case SD_EVENT_INSERTED:
+      showReadyToUpload();
+      publishSDStatus();
+      break;
+    case SD_EVENT_REMOVED:
+      dropOpenOutputFiles();
       showSDRemoved();
-    }
+      break;
+    case SD_EVENT_NONE:
+      break;
   }
+  reconcileFreeSpace();
 
   static unsigned long lastHeapLogTime = 0;
   if (millis() - lastHeapLogTime > 5000) { // Log heap every 5 seconds
@@ -64,21 +64,36 @@ void messageHandler(char* topic, byte* payload, unsigned int length) {
       int totalFilesInBatch = arr.size();
       int fileIndex = 1;
       Serial.printf("[MQTT] Presigned URL batch contains %d file(s).\n", totalFilesInBatch);
+      uint16_t batch = totalFilesInBatch > 0 ? beginDownloadBatch(totalFilesInBatch) : 0;
 
       for (JsonObject obj : arr) {
         const char* presigned_url_str = obj["presignedUrl"];
         const char* s3_key_str = obj["key"]; // Get the S3 key
+        const char* priority_str = obj["priority"] | "bulk"; // "interactive" jumps ahead of bulk batches
+        DownloadOptions options;
+        options.sizeHint = obj["size"] | -1; // Optional, lets the scheduler run short files first
+        options.encoding = contentEncodingFromName(obj["encoding"] | ""); // Stored compressed: "gzip", "deflate" or "lz4"
+        // "tar": one object holding many samples, fetched with a single request
+        options.container = strcmp(obj["bundle"] | "", "tar") == 0 ? JOB_CONTAINER_TAR : JOB_CONTAINER_NONE;
+        options.etag = obj["etag"]; // Optional; a file already on the card at this ETag is skipped
+        options.batch = batch;
 
         if (presigned_url_str && s3_key_str) { // Check both are present
           Serial.printf("[MQTT] Enqueueing file %d/%d: Key='%s'\n", 
                         fileIndex, totalFilesInBatch, s3_key_str);
 
   
-          enqueueDownloadUrl(presigned_url_str, s3_key_str); 
+          options.priority = strcmp(priority_str, "interactive") == 0 ? JOB_PRIORITY_INTERACTIVE : JOB_PRIORITY_BULK;
+          if (options.encoding == CONTENT_ENCODING_UNKNOWN) {
+            Serial.printf("[MQTT] File %d/%d: unknown 'encoding', relying on Content-Encoding.\n", fileIndex, totalFilesInBatch);
+            options.encoding = CONTENT_ENCODING_IDENTITY;
+          }
+          enqueueDownloadUrl(presigned_url_str, s3_key_str, options); 
 
         } else {
             if (!presigned_url_str) Serial.printf("[MQTT] File %d/%d: 'presignedUrl' missing in JSON item.\n", fileIndex, totalFilesInBatch);
             if (!s3_key_str) Serial.printf("[MQTT] File %d/%d: 'key' missing in JSON item.\n", fileIndex, totalFilesInBatch);
+            dropBatchFile(batch);
         }
         fileIndex++;
       }
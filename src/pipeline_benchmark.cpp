@@ -0,0 +1,102 @@
+#include "app.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <algorithm>
+
+#if PIPELINE_BENCHMARK
+
+// Objects to fetch: BENCHMARK_URL_FORMAT is a printf format taking the file number 1..N, e.g.
+// "https://<bucket>.s3.amazonaws.com/bench/file_%d.bin". Upload objects of the sizes to measure
+// and define it in secrets.h or build_flags.
+#ifndef BENCHMARK_URL_FORMAT
+#error "PIPELINE_BENCHMARK needs BENCHMARK_URL_FORMAT"
+#endif
+#define BENCHMARK_ROUND_TIMEOUT_MS 600000
+#define BENCHMARK_POLL_MS          100
+
+// The file the pipeline will write for `url`: the last path segment, without the query
+static void benchmarkFilename(const char* url, char* filename, size_t filenameSize) {
+    const char* path = strstr(url, "://");
+    path = path ? strchr(path + 3, '/') : nullptr;
+    const char* start = path ? path : url;
+    size_t end = strcspn(start, "?");
+    const char* slash = start;
+    for (size_t i = 0; i < end; i++) {
+        if (start[i] == '/') slash = start + i + 1;
+    }
+    size_t length = std::min((size_t)(start + end - slash), filenameSize - 1);
+    memcpy(filename, slash, length);
+    filename[length] = '\0';
+}
+
+static void runBenchmarkRound(int round) {
+    char url[256];
+    char key[S3_KEY_MAX_LENGTH];
+    char filename[FILENAME_MAX_LENGTH];
+    char path[128];
+
+    // Start from an empty card so nothing is skipped as unchanged or resumed from a journal
+    for (int i = 1; i <= BENCHMARK_FILE_COUNT; i++) {
+        snprintf(url, sizeof(url), BENCHMARK_URL_FORMAT, i);
+        benchmarkFilename(url, filename, sizeof(filename));
+        snprintf(path, sizeof(path), "%s/%s", SAMPLE_DIRECTORY, filename);
+        if (SD_CARD.exists(path)) SD_CARD.remove(path);
+        removeSampleRecord(filename);
+        removeDownloadJournal(filename);
+    }
+
+    static LatencyHistogram latenciesBefore[STAGE_COUNT];
+    static LatencyHistogram latencies[STAGE_COUNT];
+    getStageLatencies(latenciesBefore);
+    PipelineStats before;
+    getPipelineStats(before);
+    unsigned long startMillis = millis();
+    for (int i = 1; i <= BENCHMARK_FILE_COUNT; i++) {
+        snprintf(url, sizeof(url), BENCHMARK_URL_FORMAT, i);
+        snprintf(key, sizeof(key), "bench/%d", i);
+        enqueueDownloadUrl(url, key);
+    }
+
+    PipelineStats after;
+    uint32_t finished = 0;
+    do {
+        vTaskDelay(pdMS_TO_TICKS(BENCHMARK_POLL_MS));
+        getPipelineStats(after);
+        finished = (after.filesCompleted - before.filesCompleted) + (after.filesFailed - before.filesFailed);
+    } while (finished < BENCHMARK_FILE_COUNT && millis() - startMillis < BENCHMARK_ROUND_TIMEOUT_MS);
+    unsigned long elapsedMs = millis() - startMillis;
+
+    uint32_t completed = after.filesCompleted - before.filesCompleted;
+    uint32_t bytesWritten = after.bytesWritten - before.bytesWritten;
+    uint32_t samples = after.chunkQueueSamples - before.chunkQueueSamples;
+    Serial.printf("[Benchmark] Round %d: %lu/%d files, %lu bytes received, %lu written in %lu ms = %.2f MB/s\n",
+                  round, (unsigned long)completed, BENCHMARK_FILE_COUNT,
+                  (unsigned long)(after.bytesReceived - before.bytesReceived), (unsigned long)bytesWritten,
+                  elapsedMs, elapsedMs > 0 ? bytesWritten / 1048.576f / elapsedMs : 0.0f);
+    Serial.printf("[Benchmark] Round %d: file latency avg %lu ms, max %lu ms (max since boot)\n", round,
+                  completed > 0 ? (unsigned long)((after.fileLatencyTotalMs - before.fileLatencyTotalMs) / completed) : 0UL,
+                  (unsigned long)after.fileLatencyMaxMs);
+    Serial.printf("[Benchmark] Round %d: chunk queue avg %.1f, max %lu of %lu, %lu chunk buffers\n", round,
+                  samples > 0 ? (float)(after.chunkQueueOccupancyTotal - before.chunkQueueOccupancyTotal) / samples : 0.0f,
+                  (unsigned long)after.chunkQueueOccupancyMax, (unsigned long)after.chunkQueueCapacity,
+                  (unsigned long)after.chunkBuffers);
+
+    // This round's samples only
+    getStageLatencies(latencies);
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        latencies[stage].samples -= latenciesBefore[stage].samples;
+        for (int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+            latencies[stage].counts[bucket] -= latenciesBefore[stage].counts[bucket];
+        }
+    }
+    logStageLatencies(latencies);
+    if (finished < BENCHMARK_FILE_COUNT) Serial.printf("[Benchmark] Round %d timed out.\n", round);
+}
+
+void runPipelineBenchmark() {
+    Serial.printf("[Benchmark] %d rounds of %d files\n", BENCHMARK_ROUNDS, BENCHMARK_FILE_COUNT);
+    for (int round = 1; round <= BENCHMARK_ROUNDS; round++) runBenchmarkRound(round);
+    Serial.println("[Benchmark] Done.");
+}
+
+#endif
@@ -0,0 +1,300 @@
+#include "app.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <time.h>
+
+#define SAMPLE_INDEX_PATH        SPCLOUD_DIRECTORY "/samples.idx"
+#define SAMPLE_INDEX_BUILD_PATH  SPCLOUD_DIRECTORY "/samples.new"
+#define SAMPLE_INDEX_MAGIC       0x58444E49 // "INDX"
+#define SAMPLE_INDEX_VERSION     1
+#define SAMPLE_INDEX_MIN_BUCKETS 128        // 32 KB on the card; doubles when three quarters full
+#define CLOCK_VALID_AFTER        1600000000 // Before this the clock has not been set by NTP
+
+// Record states
+#define RECORD_EMPTY   0 // Ends a probe sequence
+#define RECORD_USED    1
+#define RECORD_DELETED 2 // Keeps probe sequences intact, reused on insert
+
+// The index is an open-addressing hash table of SampleRecords keyed by filename. The header
+// takes the first record's space, so bucket i lives at (i + 1) * sizeof(SampleRecord).
+struct SampleIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t bucketCount;       // Power of two
+    uint32_t fileCount;
+    uint64_t totalBytes;
+};
+static_assert(sizeof(SampleIndexHeader) <= sizeof(SampleRecord), "Header must fit in bucket 0's space");
+static_assert(sizeof(SampleRecord) == 256, "Keep records sector-friendly");
+
+// Workers look records up while writeTask updates them, hence the lock
+static SemaphoreHandle_t sampleIndexLock = NULL;
+static SampleIndexHeader header;
+static bool indexLoaded = false;
+
+void initSampleIndex() {
+    if (!sampleIndexLock) sampleIndexLock = xSemaphoreCreateMutex();
+}
+
+static uint32_t hashFilename(const char* filename) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (; *filename; filename++) hash = (hash ^ (uint8_t)*filename) * 16777619u;
+    return hash;
+}
+
+static uint32_t bucketPosition(uint32_t bucket) {
+    return (bucket + 1) * sizeof(SampleRecord);
+}
+
+static bool readBucket(File& index, uint32_t bucket, SampleRecord& record) {
+    if (!index.seek(bucketPosition(bucket))) return false;
+    if (index.read((uint8_t*)&record, sizeof(record)) != sizeof(record)) return false;
+    record.filename[sizeof(record.filename) - 1] = '\0';
+    record.s3Key[sizeof(record.s3Key) - 1] = '\0';
+    record.etag[sizeof(record.etag) - 1] = '\0';
+    return true;
+}
+
+static bool writeBucket(File& index, uint32_t bucket, const SampleRecord& record) {
+    return index.seek(bucketPosition(bucket)) && index.write((const uint8_t*)&record, sizeof(record)) == sizeof(record);
+}
+
+static bool writeHeader(File& index, const SampleIndexHeader& indexHeader) {
+    uint8_t block[sizeof(SampleRecord)] = {0};
+    memcpy(block, &indexHeader, sizeof(indexHeader));
+    return index.seek(0) && index.write(block, sizeof(block)) == sizeof(block);
+}
+
+// Bucket holding `filename`, or where it would go (the first deleted or empty bucket on its
+// probe sequence). Sets `found` if it is there. -1 if the table is full or unreadable.
+static int32_t probe(File& index, uint32_t bucketCount, const char* filename, bool& found) {
+    found = false;
+    int32_t reusable = -1;
+    uint32_t mask = bucketCount - 1;
+    uint32_t bucket = hashFilename(filename) & mask;
+    SampleRecord record;
+    for (uint32_t step = 0; step < bucketCount; step++, bucket = (bucket + 1) & mask) {
+        if (!readBucket(index, bucket, record)) return -1;
+        if (record.state == RECORD_EMPTY) return reusable >= 0 ? reusable : (int32_t)bucket;
+        if (record.state == RECORD_DELETED) {
+            if (reusable < 0) reusable = bucket;
+        } else if (strcmp(record.filename, filename) == 0) {
+            found = true;
+            return bucket;
+        }
+    }
+    return reusable;
+}
+
+// Writes an empty table of `bucketCount` buckets to `path`
+static bool createTable(const char* path, uint32_t bucketCount, SampleIndexHeader& indexHeader) {
+    SD_CARD.mkdir(SPCLOUD_DIRECTORY);
+    File index = SD_CARD.open(path, FILE_WRITE);
+    if (!index) return false;
+    memset(&indexHeader, 0, sizeof(indexHeader));
+    indexHeader.magic = SAMPLE_INDEX_MAGIC;
+    indexHeader.version = SAMPLE_INDEX_VERSION;
+    indexHeader.recordSize = sizeof(SampleRecord);
+    indexHeader.bucketCount = bucketCount;
+    bool ok = writeHeader(index, indexHeader);
+    SampleRecord empty;
+    memset(&empty, 0, sizeof(empty));
+    for (uint32_t bucket = 0; ok && bucket < bucketCount; bucket++) {
+        ok = index.write((const uint8_t*)&empty, sizeof(empty)) == sizeof(empty);
+    }
+    index.close();
+    if (!ok) SD_CARD.remove(path);
+    return ok;
+}
+
+// Inserts or replaces `record` in an open table, keeping the header's totals. False on a
+// write error or a full table.
+static bool storeRecord(File& index, SampleIndexHeader& indexHeader, const SampleRecord& record) {
+    bool found;
+    int32_t bucket = probe(index, indexHeader.bucketCount, record.filename, found);
+    if (bucket < 0) return false;
+    if (found) {
+        SampleRecord previous;
+        if (!readBucket(index, bucket, previous)) return false;
+        indexHeader.fileCount--;
+        indexHeader.totalBytes -= previous.size;
+    }
+    SampleRecord stored = record;
+    stored.state = RECORD_USED;
+    if (!writeBucket(index, bucket, stored)) return false;
+    indexHeader.fileCount++;
+    indexHeader.totalBytes += record.size;
+    return true;
+}
+
+// Copies every record into a table twice the size and swaps it in. Call with the lock held.
+static bool growIndex() {
+    SampleIndexHeader grown;
+    if (!createTable(SAMPLE_INDEX_BUILD_PATH, header.bucketCount * 2, grown)) return false;
+    File index = SD_CARD.open(SAMPLE_INDEX_PATH, FILE_READ);
+    File target = SD_CARD.open(SAMPLE_INDEX_BUILD_PATH, "r+");
+    bool ok = index && target;
+    SampleRecord record;
+    for (uint32_t bucket = 0; ok && bucket < header.bucketCount; bucket++) {
+        ok = readBucket(index, bucket, record);
+        if (ok && record.state == RECORD_USED) ok = storeRecord(target, grown, record);
+    }
+    ok = ok && writeHeader(target, grown);
+    if (index) index.close();
+    if (target) target.close();
+    if (ok) ok = SD_CARD.remove(SAMPLE_INDEX_PATH) && SD_CARD.rename(SAMPLE_INDEX_BUILD_PATH, SAMPLE_INDEX_PATH);
+    if (!ok) {
+        Serial.println("[SampleIndex] Failed to grow the index!");
+        SD_CARD.remove(SAMPLE_INDEX_BUILD_PATH);
+        return false;
+    }
+    header = grown;
+    Serial.printf("[SampleIndex] Grew to %lu buckets\n", (unsigned long)header.bucketCount);
+    return true;
+}
+
+// Builds the index from a walk of SAMPLE_DIRECTORY. Files found this way have no object key,
+// ETag or CRC; they gain them when they are next downloaded.
+static bool rebuildIndex() {
+    unsigned long startMillis = millis();
+    SD_CARD.remove(SAMPLE_INDEX_PATH);
+    if (!createTable(SAMPLE_INDEX_PATH, SAMPLE_INDEX_MIN_BUCKETS, header)) {
+        Serial.println("[SampleIndex] Failed to create the index!");
+        return false;
+    }
+    indexLoaded = true;
+
+    File directory = SD_CARD.open(SAMPLE_DIRECTORY);
+    if (directory && directory.isDirectory()) {
+        for (File entry = directory.openNextFile(); entry; entry = directory.openNextFile()) {
+            SampleRecord record;
+            memset(&record, 0, sizeof(record));
+            const char* name = strrchr(entry.name(), '/');
+            name = name ? name + 1 : entry.name();
+            bool usable = !entry.isDirectory() && strlen(name) < sizeof(record.filename);
+            if (usable) {
+                strcpy(record.filename, name);
+                record.size = entry.size();
+                record.mtime = entry.getLastWrite();
+            }
+            entry.close();
+            if (!usable) continue;
+
+            if ((header.fileCount + 1) * 4 > header.bucketCount * 3 && !growIndex()) break;
+            File index = SD_CARD.open(SAMPLE_INDEX_PATH, "r+");
+            bool stored = index && storeRecord(index, header, record) && writeHeader(index, header);
+            if (index) index.close();
+            if (!stored) break;
+        }
+    }
+    if (directory) directory.close();
+    Serial.printf("[SampleIndex] Rebuilt: %lu files, %llu bytes in %lu ms\n", (unsigned long)header.fileCount,
+                  (unsigned long long)header.totalBytes, millis() - startMillis);
+    return true;
+}
+
+// Loads the header, rebuilding the index if it is missing or unreadable. Call with the lock held.
+static bool ensureIndex() {
+    if (indexLoaded) return true;
+    File index = SD_CARD.open(SAMPLE_INDEX_PATH, FILE_READ);
+    if (index) {
+        bool valid = index.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                     header.magic == SAMPLE_INDEX_MAGIC && header.version == SAMPLE_INDEX_VERSION &&
+                     header.recordSize == sizeof(SampleRecord) && header.bucketCount >= SAMPLE_INDEX_MIN_BUCKETS &&
+                     (header.bucketCount & (header.bucketCount - 1)) == 0 &&
+                     index.size() == bucketPosition(header.bucketCount);
+        index.close();
+        if (valid) {
+            indexLoaded = true;
+            return true;
+        }
+        Serial.println("[SampleIndex] Index is corrupt, rebuilding.");
+    }
+    return rebuildIndex();
+}
+
+static void lockIndex() {
+    xSemaphoreTake(sampleIndexLock, portMAX_DELAY);
+}
+
+static void unlockIndex() {
+    xSemaphoreGive(sampleIndexLock);
+}
+
+// The card may have been swapped: load the header again on the next access
+void resetSampleIndex() {
+    if (!sampleIndexLock) {
+        indexLoaded = false; // No task can be using the index yet
+        return;
+    }
+    lockIndex();
+    indexLoaded = false;
+    unlockIndex();
+}
+
+bool findSampleRecord(const char* filename, SampleRecord& record) {
+    if (!sampleIndexLock) return false;
+    lockIndex();
+    bool found = false;
+    if (ensureIndex()) {
+        File index = SD_CARD.open(SAMPLE_INDEX_PATH, FILE_READ);
+        if (index) {
+            int32_t bucket = probe(index, header.bucketCount, filename, found);
+            found = found && readBucket(index, bucket, record);
+            index.close();
+        }
+    }
+    unlockIndex();
+    return found;
+}
+
+void recordSample(const SampleRecord& record) {
+    if (!sampleIndexLock) return;
+    lockIndex();
+    if (!ensureIndex() || ((header.fileCount + 1) * 4 > header.bucketCount * 3 && !growIndex())) {
+        unlockIndex();
+        return;
+    }
+    SampleRecord stored = record;
+    if (stored.mtime == 0) {
+        time_t now = time(nullptr);
+        if (now > CLOCK_VALID_AFTER) stored.mtime = now;
+    }
+    File index = SD_CARD.open(SAMPLE_INDEX_PATH, "r+");
+    if (!index || !storeRecord(index, header, stored) || !writeHeader(index, header)) {
+        Serial.printf("[SampleIndex] Failed to record %s\n", record.filename);
+        indexLoaded = false; // Reload the header, or rebuild, on the next access
+    }
+    if (index) index.close();
+    unlockIndex();
+}
+
+void removeSampleRecord(const char* filename) {
+    if (!sampleIndexLock) return;
+    lockIndex();
+    if (ensureIndex()) {
+        File index = SD_CARD.open(SAMPLE_INDEX_PATH, "r+");
+        bool found = false;
+        int32_t bucket = index ? probe(index, header.bucketCount, filename, found) : -1;
+        SampleRecord record;
+        if (found && readBucket(index, bucket, record)) {
+            record.state = RECORD_DELETED;
+            header.fileCount--;
+            header.totalBytes -= record.size;
+            if (!writeBucket(index, bucket, record) || !writeHeader(index, header)) indexLoaded = false;
+        }
+        if (index) index.close();
+    }
+    unlockIndex();
+}
+
+bool sampleIndexTotals(uint32_t& fileCount, uint64_t& totalBytes) {
+    if (!sampleIndexLock) return false;
+    lockIndex();
+    bool loaded = ensureIndex();
+    fileCount = header.fileCount;
+    totalBytes = header.totalBytes;
+    unlockIndex();
+    return loaded;
+}
@@ -0,0 +1,64 @@
+#include "app.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <algorithm>
+
+#if SD_WRITE_BENCHMARK
+
+#ifndef SD_BENCHMARK_BYTES
+#define SD_BENCHMARK_BYTES (4 * 1024 * 1024) // Written once per block size
+#endif
+#define SD_BENCHMARK_PATH  SPCLOUD_DIRECTORY "/sdbench.tmp"
+
+// 512 is a sector; 8192 is writeTask's default coalescing size
+static const size_t benchmarkBlockSizes[] = {512, 2048, 8192, 16384, 32768};
+
+static void runBlockSize(uint8_t* block, size_t blockSize) {
+    File file = SD_CARD.open(SD_BENCHMARK_PATH, FILE_WRITE);
+    if (!file) {
+        Serial.println("[SDBench] Could not create the test file!");
+        return;
+    }
+    uint32_t maxWriteUs = 0;
+    size_t written = 0;
+    unsigned long startMicros = micros();
+    while (written < SD_BENCHMARK_BYTES) {
+        unsigned long writeStart = micros();
+        size_t n = file.write(block, blockSize);
+        maxWriteUs = std::max<uint32_t>(maxWriteUs, micros() - writeStart);
+        if (n != blockSize) break;
+        written += n;
+    }
+    file.close(); // Includes the final flush, as writeTask's timings do
+    unsigned long elapsedUs = micros() - startMicros;
+    SD_CARD.remove(SD_BENCHMARK_PATH);
+
+    Serial.printf("[SDBench] %5u-byte writes: %lu bytes in %lu ms = %.2f MB/s, slowest write %lu us%s\n",
+                  (unsigned)blockSize, (unsigned long)written, elapsedUs / 1000,
+                  elapsedUs > 0 ? written / 1.048576f / elapsedUs : 0.0f, (unsigned long)maxWriteUs,
+                  written < SD_BENCHMARK_BYTES ? " (write failed)" : "");
+}
+
+void runSDWriteBenchmark() {
+    if (!storage().isPresent()) {
+        Serial.println("[SDBench] No card, skipped.");
+        return;
+    }
+    const size_t largest = *std::max_element(std::begin(benchmarkBlockSizes), std::end(benchmarkBlockSizes));
+    uint8_t* block = (uint8_t*)malloc(largest);
+    if (!block) {
+        Serial.println("[SDBench] Out of memory.");
+        return;
+    }
+    for (size_t i = 0; i < largest; i++) block[i] = (uint8_t)i;
+
+    Serial.printf("[SDBench] %s, %lu bytes per block size\n", storage().name(), (unsigned long)SD_BENCHMARK_BYTES);
+    for (size_t blockSize : benchmarkBlockSizes) {
+        runBlockSize(block, blockSize);
+        vTaskDelay(1); // Let the idle task feed the watchdog between runs
+    }
+    free(block);
+    Serial.println("[SDBench] Done.");
+}
+
+#endif
@@ -1,35 +1,106 @@
 #include "app.h"
+#include <atomic>
 
-#define SD_CS 5  // SD card chip select pin
+#define FREE_SPACE_RECONCILE_MS 60000 // Recount at most this often, and only while the card is idle
+
+// Free space in clusters, counted once at mount and then kept up to date by the write path, so
+// reading it never touches the card. Files other than downloads (journals, the sample index)
+// are not reported and drift it slightly until the next reconcile.
+static std::atomic<int32_t> freeClusters(0);
+static std::atomic<bool> freeSpaceKnown(false);
+static uint32_t clusterBytes = 0;
+static uint64_t cardTotalBytes = 0;
+static unsigned long lastReconcileAt = 0;
+
+static int32_t clustersFor(uint32_t size) {
+  return ((uint64_t)size + clusterBytes - 1) / clusterBytes;
+}
+
+// Asks the filesystem. After mount FATFS answers from the FSInfo sector when that is valid and
+// scans the whole FAT otherwise, so this is kept off the hot path.
+static bool countFreeClusters(int32_t& clusters) {
+  uint64_t total = storage().totalBytes();
+  uint64_t used = storage().usedBytes();
+  if (total == 0 || clusterBytes == 0 || used > total) return false;
+  clusters = (total - used) / clusterBytes;
+  cardTotalBytes = total;
+  return true;
+}
+
+void initFreeSpace() {
+  unsigned long startMillis = millis();
+  freeSpaceKnown = false;
+  clusterBytes = storage().clusterSize();
+  int32_t clusters;
+  if (!countFreeClusters(clusters)) {
+    Serial.println("[SD] Could not read the free space.");
+    return;
+  }
+  freeClusters = clusters;
+  freeSpaceKnown = true;
+  lastReconcileAt = millis();
+  Serial.printf("[SD] %lu MB free of %lu MB (%lu-byte clusters), counted in %lu ms\n",
+                (unsigned long)((uint64_t)clusters * clusterBytes / (1024 * 1024)),
+                (unsigned long)(cardTotalBytes / (1024 * 1024)), (unsigned long)clusterBytes, millis() - startMillis);
+}
+
+void noteFileResized(uint32_t oldSize, uint32_t newSize) {
+  if (!freeSpaceKnown || oldSize == newSize) return;
+  freeClusters -= clustersFor(newSize) - clustersFor(oldSize);
+}
+
+void reconcileFreeSpace() {
+  if (!freeSpaceKnown || !isSDCardReady() || millis() - lastReconcileAt < FREE_SPACE_RECONCILE_MS) return;
+  if (isCardWriteInProgress()) return;
+  lastReconcileAt = millis();
+  int32_t tracked = freeClusters;
+  int32_t counted;
+  // A write that started meanwhile may have been noted against the old count; try again later
+  if (!countFreeClusters(counted) || isCardWriteInProgress() || freeClusters != tracked) return;
+  freeClusters = counted;
+  if (counted != tracked) {
+    Serial.printf("[SD] Free space corrected by %ld clusters\n", (long)(counted - tracked));
+  }
+}
 
 void setupSD() {
-  if (!SD.begin(SD_CS)) {
+  if (!storage().mount()) {
     Serial.println("SD Card Mount Failed");
     return;
   }
  
-  uint8_t cardType = SD.cardType();
-  if (cardType == CARD_NONE) {
+  if (!storage().isPresent()) {
     Serial.println("\n\nNo SD card attached");
     return;
   }
 
-  Serial.println("\n\nSD Card Initialized");
+  Serial.printf("\n\nSD Card Initialized (%s)\n", storage().name());
+  resetSampleIndex();
+  prepareStagingDirectory();
+  initFreeSpace();
 }
 
 uint64_t getAvailableSpace() {
-  if (SD.cardType() == CARD_NONE) return 0;
-  return (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024); // Return in MB
+  if (!freeSpaceKnown || !isSDCardReady()) return 0;
+  int32_t clusters = freeClusters;
+  return clusters > 0 ? (uint64_t)clusters * clusterBytes / (1024 * 1024) : 0; // Return in MB
 }
 
 void publishSDStatus() {
   uint64_t freeSpaceMB = getAvailableSpace();
-  uint64_t totalSpaceMB = SD.totalBytes() / (1024 * 1024);
+  uint64_t totalSpaceMB = cardTotalBytes / (1024 * 1024);
   
-  StaticJsonDocument<200> doc;
+  StaticJsonDocument<256> doc;
   doc["storage"]["free"] = freeSpaceMB;
   doc["storage"]["total"] = totalSpaceMB;
   doc["storage"]["unit"] = "MB";
+
+  uint32_t sampleCount;
+  uint64_t sampleBytes;
+  if (sampleIndexTotals(sampleCount, sampleBytes)) { // From the sample index, no directory walk
+    doc["samples"]["count"] = sampleCount;
+    doc["samples"]["size"] = sampleBytes / (1024 * 1024);
+  }
   
   char jsonBuffer[512];
   serializeJson(doc, jsonBuffer);
@@ -0,0 +1,91 @@
+#include "app.h"
+#include <atomic>
+
+// Card-detect switch of the socket, if wired. Most sockets close it to ground when a card is in.
+#ifndef SD_DETECT_PIN
+#define SD_DETECT_PIN -1
+#endif
+#ifndef SD_DETECT_INSERTED_LEVEL
+#define SD_DETECT_INSERTED_LEVEL LOW
+#endif
+#define SD_DETECT_DEBOUNCE_MS  50
+#define SD_PROBE_INTERVAL_MS   2000 // Without a detect pin: status probe of a mounted card
+#define SD_MOUNT_RETRY_MS      2000 // While absent: mount attempts (needs a card, so no write is in progress)
+
+// Presence as last established, read by any task. Only updateSDPresence() changes it.
+static std::atomic<bool> cardReady(false);
+static std::atomic<bool> detectChanged(false);
+static std::atomic<unsigned long> detectChangedAt(0);
+static unsigned long lastProbeAt = 0;
+static unsigned long lastMountAt = 0;
+
+#if SD_DETECT_PIN >= 0
+static void IRAM_ATTR onDetectChange() {
+    detectChangedAt = millis();
+    detectChanged = true;
+}
+
+static bool detectPinSaysInserted() {
+    return digitalRead(SD_DETECT_PIN) == SD_DETECT_INSERTED_LEVEL;
+}
+#endif
+
+bool isSDCardReady() {
+    return cardReady;
+}
+
+void initSDPresence() {
+#if SD_DETECT_PIN >= 0
+    pinMode(SD_DETECT_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(SD_DETECT_PIN), onDetectChange, CHANGE);
+    Serial.printf("[SDPresence] Card detect on GPIO %d\n", SD_DETECT_PIN);
+#else
+    Serial.println("[SDPresence] No card detect pin, probing with CMD13");
+#endif
+    cardReady = storage().isPresent() && storage().probe();
+    lastProbeAt = lastMountAt = millis();
+}
+
+static SDCardEvent cardRemoved() {
+    cardReady = false;
+    Serial.println("[SDPresence] Card removed.");
+    return SD_EVENT_REMOVED;
+}
+
+// Never remounts under writeTask: its open files belong to the card that was removed
+static SDCardEvent tryMount() {
+    lastMountAt = millis();
+    if (isCardWriteInProgress()) return SD_EVENT_NONE;
+    if (!storage().mount() || !storage().isPresent()) return SD_EVENT_NONE;
+    resetSampleIndex();
+    prepareStagingDirectory();
+    initFreeSpace();
+    cardReady = true;
+    Serial.printf("[SDPresence] Card inserted (%s).\n", storage().name());
+    return SD_EVENT_INSERTED;
+}
+
+// Runs from loop(). Never touches the bus while writeTask is writing: a card that is being
+// written to is evidently there, and a removal mid-write surfaces as a write error anyway.
+SDCardEvent updateSDPresence() {
+    unsigned long now = millis();
+#if SD_DETECT_PIN >= 0
+    // The switch is authoritative; the bus is only used to mount
+    if (detectChanged && now - detectChangedAt >= SD_DETECT_DEBOUNCE_MS) {
+        detectChanged = false;
+        if (!detectPinSaysInserted()) return cardReady ? cardRemoved() : SD_EVENT_NONE;
+        lastMountAt = now - SD_MOUNT_RETRY_MS; // Mount right away
+    }
+    if (!cardReady && detectPinSaysInserted() && now - lastMountAt >= SD_MOUNT_RETRY_MS) return tryMount();
+    return SD_EVENT_NONE;
+#else
+    if (cardReady) {
+        if (now - lastProbeAt < SD_PROBE_INTERVAL_MS) return SD_EVENT_NONE;
+        lastProbeAt = now;
+        if (isCardWriteInProgress() || storage().probe()) return SD_EVENT_NONE;
+        return cardRemoved();
+    }
+    if (now - lastMountAt >= SD_MOUNT_RETRY_MS) return tryMount();
+    return SD_EVENT_NONE;
+#endif
+}
@@ -0,0 +1,73 @@
+#include "app.h"
+#include <atomic>
+
+// One counter per stage and bucket. Recording is a single relaxed increment, so any task can
+// record without a lock; a snapshot taken while others record may be off by the samples in flight.
+struct StageCounters {
+    std::atomic<uint32_t> counts[LATENCY_BUCKET_COUNT];
+    std::atomic<uint32_t> maxUs;
+};
+
+static StageCounters stageCounters[STAGE_COUNT];
+
+static const char* const stageNames[STAGE_COUNT] = {
+    "dns", "tls_connect", "http_begin", "http_get", "stream_read",
+    "buffer_wait", "queue_send", "sd_open", "sd_write", "sd_close",
+};
+
+const char* pipelineStageName(PipelineStage stage) {
+    return stage < STAGE_COUNT ? stageNames[stage] : "?";
+}
+
+static uint8_t latencyBucket(uint32_t micros) {
+    uint8_t bucket = 0;
+    while (micros > 1 && bucket < LATENCY_BUCKET_COUNT - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void recordStageLatency(PipelineStage stage, uint32_t micros) {
+    if (stage >= STAGE_COUNT) return;
+    StageCounters& counters = stageCounters[stage];
+    counters.counts[latencyBucket(micros)].fetch_add(1, std::memory_order_relaxed);
+    uint32_t current = counters.maxUs.load(std::memory_order_relaxed);
+    while (micros > current && !counters.maxUs.compare_exchange_weak(current, micros, std::memory_order_relaxed)) {}
+}
+
+void getStageLatencies(LatencyHistogram histograms[STAGE_COUNT]) {
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        const StageCounters& counters = stageCounters[stage];
+        LatencyHistogram& histogram = histograms[stage];
+        histogram.samples = 0;
+        for (int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+            histogram.counts[bucket] = counters.counts[bucket].load(std::memory_order_relaxed);
+            histogram.samples += histogram.counts[bucket];
+        }
+        histogram.maxUs = counters.maxUs.load(std::memory_order_relaxed);
+    }
+}
+
+uint32_t latencyPercentileUs(const LatencyHistogram& histogram, uint8_t percent) {
+    if (histogram.samples == 0) return 0;
+    uint32_t rank = ((uint64_t)histogram.samples * percent + 99) / 100; // Samples at or below the answer
+    uint32_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+        seen += histogram.counts[bucket];
+        if (seen >= rank) return bucket < LATENCY_BUCKET_COUNT - 1 ? (2u << bucket) - 1 : histogram.maxUs;
+    }
+    return histogram.maxUs;
+}
+
+void logStageLatencies(const LatencyHistogram histograms[STAGE_COUNT]) {
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        const LatencyHistogram& histogram = histograms[stage];
+        if (histogram.samples == 0) continue;
+        Serial.printf("[Latency] %-12s n=%lu p50<=%lu us p95<=%lu us p99<=%lu us\n",
+                      stageNames[stage], (unsigned long)histogram.samples,
+                      (unsigned long)latencyPercentileUs(histogram, 50),
+                      (unsigned long)latencyPercentileUs(histogram, 95),
+                      (unsigned long)latencyPercentileUs(histogram, 99));
+    }
+}
@@ -0,0 +1,132 @@
+#include "app.h"
+#include <unistd.h>
+#include <diskio_impl.h>
+#include <ff.h>
+
+#if SD_INTERFACE == SD_INTERFACE_SDMMC
+#include <SD_MMC.h>
+#elif SD_INTERFACE != SD_INTERFACE_SPI
+#error "SD_INTERFACE must be SD_INTERFACE_SPI or SD_INTERFACE_SDMMC"
+#endif
+
+#define SD_MOUNT_POINT "/sd" // Where the card is mounted in the VFS, for POSIX calls
+#define SD_CS 5              // SD card chip select pin (SPI interface)
+#define NO_DRIVE 0xFF
+
+// SPI clock. 25 MHz is the SD default-speed limit; long or breadboard wiring may need less.
+#ifndef SD_SPI_FREQUENCY
+#define SD_SPI_FREQUENCY 25000000
+#endif
+#define SD_SPI_FALLBACK_FREQUENCY 4000000 // Arduino's default, used if the card will not mount faster
+
+// SDMMC bus: 4 data lines need D1-D3 wired (and pulled up); 1 only needs D0
+#ifndef SD_MMC_BUS_WIDTH
+#define SD_MMC_BUS_WIDTH 4
+#endif
+#ifndef SD_MMC_FREQUENCY_KHZ
+#define SD_MMC_FREQUENCY_KHZ SDMMC_FREQ_HIGHSPEED
+#endif
+static_assert(SD_MMC_BUS_WIDTH == 1 || SD_MMC_BUS_WIDTH == 4, "SD_MMC_BUS_WIDTH must be 1 or 4");
+
+bool StorageBackend::stat(const char* path, StorageStat& st) {
+    File file = files().open(path, FILE_READ);
+    if (!file) return false;
+    st.isDirectory = file.isDirectory();
+    st.size = st.isDirectory ? 0 : file.size();
+    st.mtime = file.getLastWrite();
+    file.close();
+    return true;
+}
+
+// The card on the interface selected by SD_INTERFACE
+class SDCardStorage : public StorageBackend {
+public:
+    const char* name() const override {
+#if SD_INTERFACE == SD_INTERFACE_SDMMC
+        return SD_MMC_BUS_WIDTH == 4 ? "SDMMC 4-bit" : "SDMMC 1-bit";
+#else
+        return "SPI";
+#endif
+    }
+
+    // Unmounts first, since begin() on a mounted card returns without touching it
+    bool mount() override {
+        card().end();
+        drive = NO_DRIVE;
+        // Both drivers register the card as the first free FATFS drive; note which one that is
+        BYTE nextDrive;
+        if (ff_diskio_get_drive(&nextDrive) != ESP_OK) return false;
+        if (!begin()) return false;
+        drive = nextDrive;
+        return true;
+    }
+
+    bool isPresent() override { return card().cardType() != CARD_NONE; }
+
+    // disk_status() sends CMD13 (SEND_STATUS) on both drivers: one short command, no FAT access
+    bool probe() override {
+        return drive != NO_DRIVE && !(disk_status(drive) & STA_NOINIT);
+    }
+
+    fs::FS& files() override { return card(); }
+    uint64_t totalBytes() override { return card().totalBytes(); }
+    uint64_t usedBytes() override { return card().usedBytes(); }
+
+    // Read from the mounted volume through a handle on its root directory. f_getfree() would
+    // also give it, but may scan the whole FAT to count the free clusters.
+    uint32_t clusterSize() override {
+        if (drive == NO_DRIVE) return 0;
+        char path[4] = {(char)('0' + drive), ':', '/', '\0'};
+        FF_DIR root;
+        if (f_opendir(&root, path) != FR_OK) return 0;
+        const FATFS* fatfs = root.obj.fs;
+#if FF_MAX_SS != FF_MIN_SS
+        uint32_t bytes = (uint32_t)fatfs->csize * fatfs->ssize;
+#else
+        uint32_t bytes = (uint32_t)fatfs->csize * FF_MAX_SS;
+#endif
+        f_closedir(&root);
+        return bytes;
+    }
+
+    // fs::File has no truncate, so this goes through the VFS
+    bool truncate(const char* path, size_t length) override {
+        char vfsPath[sizeof(SD_MOUNT_POINT) + 128];
+        snprintf(vfsPath, sizeof(vfsPath), "%s%s", SD_MOUNT_POINT, path);
+        return ::truncate(vfsPath, length) == 0;
+    }
+
+private:
+    BYTE drive = NO_DRIVE;
+
+#if SD_INTERFACE == SD_INTERFACE_SDMMC
+    SDMMCFS& card() { return SD_MMC; }
+
+    bool begin() {
+        if (SD_MMC.begin(SD_MOUNT_POINT, SD_MMC_BUS_WIDTH == 1, false, SD_MMC_FREQUENCY_KHZ, SD_MAX_OPEN_FILES)) return true;
+        if (SD_MMC_FREQUENCY_KHZ <= SDMMC_FREQ_DEFAULT) return false;
+        Serial.printf("[Storage] Mount at %d kHz failed, retrying at %d kHz\n", SD_MMC_FREQUENCY_KHZ, SDMMC_FREQ_DEFAULT);
+        return SD_MMC.begin(SD_MOUNT_POINT, SD_MMC_BUS_WIDTH == 1, false, SDMMC_FREQ_DEFAULT, SD_MAX_OPEN_FILES);
+    }
+#else
+    SDFS& card() { return SD; }
+
+    bool begin() {
+        if (SD.begin(SD_CS, SPI, SD_SPI_FREQUENCY, SD_MOUNT_POINT, SD_MAX_OPEN_FILES)) return true;
+        if (SD_SPI_FREQUENCY <= SD_SPI_FALLBACK_FREQUENCY) return false;
+        Serial.printf("[Storage] Mount at %d Hz failed, retrying at %d Hz\n", SD_SPI_FREQUENCY, SD_SPI_FALLBACK_FREQUENCY);
+        return SD.begin(SD_CS, SPI, SD_SPI_FALLBACK_FREQUENCY, SD_MOUNT_POINT, SD_MAX_OPEN_FILES);
+    }
+#endif
+};
+
+static SDCardStorage sdCardStorage;
+static StorageBackend* activeBackend = &sdCardStorage;
+
+StorageBackend& storage() {
+    return *activeBackend;
+}
+
+void setStorageBackend(StorageBackend* backend) {
+    activeBackend = backend ? backend : &sdCardStorage;
+}
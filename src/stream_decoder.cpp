@@ -0,0 +1,495 @@
+#include "app.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_heap_caps.h>
+#include <esp32/rom/miniz.h> // tinfl_decompress is in ROM
+#include <esp32/rom/crc.h>
+#include <algorithm>
+
+#ifndef STREAM_DECODER_COUNT
+#define STREAM_DECODER_COUNT  1      // Compressed jobs decoded at once; each holds a window while it runs
+#endif
+#define INFLATE_WINDOW_SIZE   TINFL_LZ_DICT_SIZE // 32 KB, the largest deflate match distance
+#define LZ4_WINDOW_SIZE       65536  // The largest LZ4 match distance, rounded up to a power of two
+#define LZ4_FRAME_MAGIC       0x184D2204
+#define LZ4_SKIPPABLE_MAGIC   0x184D2A50 // Low nibble is free
+#define GZIP_FLAG_HCRC        0x02
+#define GZIP_FLAG_EXTRA       0x04
+#define GZIP_FLAG_NAME        0x08
+#define GZIP_FLAG_COMMENT     0x10
+
+enum DecoderState : uint8_t {
+    // gzip / zlib
+    STATE_GZIP_HEADER, STATE_GZIP_EXTRA_LENGTH, STATE_GZIP_EXTRA, STATE_GZIP_NAME, STATE_GZIP_COMMENT,
+    STATE_GZIP_HEADER_CRC, STATE_ZLIB_PROBE, STATE_INFLATE, STATE_GZIP_TRAILER,
+    // LZ4 frame
+    STATE_LZ4_MAGIC, STATE_LZ4_SKIP, STATE_LZ4_DESCRIPTOR, STATE_LZ4_BLOCK_SIZE, STATE_LZ4_RAW,
+    STATE_LZ4_TOKEN, STATE_LZ4_LITERAL_LENGTH, STATE_LZ4_LITERALS, STATE_LZ4_OFFSET,
+    STATE_LZ4_MATCH_LENGTH, STATE_LZ4_MATCH, STATE_LZ4_CHECKSUM,
+};
+
+struct StreamDecoder {
+    bool inUse;
+    uint8_t encoding;           // CONTENT_ENCODING_*
+    DecoderState state;
+    DecoderState afterChecksum; // Where STATE_LZ4_CHECKSUM continues
+    bool atBoundary;            // Between gzip members or LZ4 frames: the input may end here
+    uint8_t header[16];         // Header field being collected
+    uint8_t headerFill;
+    uint8_t headerNeeded;
+    uint8_t gzipFlags;
+    uint32_t skipRemaining;     // Bytes of a header field, checksum or skippable frame still to skip
+
+    // Deflate: tinfl writes into a ring window, from where output is copied out
+    tinfl_decompressor* inflator;
+    uint32_t inflateFlags;
+    bool inflateDone;
+    bool inflateHasMore;        // tinfl stopped at the window's end: more output without more input
+    uint32_t pendingStart;      // Inflated bytes not yet copied out
+    uint32_t pendingLength;
+    uint32_t memberCrc;         // gzip CRC-32 and size of the member so far
+    uint32_t memberSize;
+
+    // LZ4: output goes to the caller and into the window, which matches copy from
+    uint8_t lz4Flags;           // Frame descriptor FLG byte
+    uint32_t blockRemaining;    // Compressed bytes left in the current block
+    uint32_t literalsRemaining;
+    uint32_t matchRemaining;
+    uint16_t matchOffset;
+    uint8_t token;
+    uint32_t windowFilled;      // Bytes ever written, capped at the window size
+
+    uint8_t* window;
+    uint32_t windowSize;        // Power of two
+    uint32_t windowPos;
+};
+
+static StreamDecoder decoders[STREAM_DECODER_COUNT];
+static SemaphoreHandle_t decoderLock = NULL;
+static SemaphoreHandle_t freeDecoders = NULL;
+
+static uint8_t* allocateWindow(size_t size) {
+    // PSRAM first: the window is large and only touched byte-wise
+    uint8_t* window = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!window) window = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    return window;
+}
+
+uint8_t contentEncodingFromName(const char* name) {
+    if (!name || name[0] == '\0' || strcasecmp(name, "identity") == 0) return CONTENT_ENCODING_IDENTITY;
+    if (strcasecmp(name, "gzip") == 0 || strcasecmp(name, "x-gzip") == 0) return CONTENT_ENCODING_GZIP;
+    if (strcasecmp(name, "deflate") == 0) return CONTENT_ENCODING_DEFLATE;
+    if (strcasecmp(name, "lz4") == 0) return CONTENT_ENCODING_LZ4;
+    return CONTENT_ENCODING_UNKNOWN;
+}
+
+static void beginMember(StreamDecoder& decoder) {
+    decoder.headerFill = 0;
+    decoder.atBoundary = false;
+    if (decoder.encoding == CONTENT_ENCODING_LZ4) {
+        decoder.state = STATE_LZ4_MAGIC;
+        decoder.headerNeeded = 4;
+        return;
+    }
+    decoder.state = decoder.encoding == CONTENT_ENCODING_GZIP ? STATE_GZIP_HEADER : STATE_ZLIB_PROBE;
+    decoder.headerNeeded = decoder.encoding == CONTENT_ENCODING_GZIP ? 10 : 2;
+    tinfl_init(decoder.inflator);
+    decoder.inflateDone = false;
+    decoder.inflateHasMore = false;
+    decoder.memberCrc = 0;
+    decoder.memberSize = 0;
+}
+
+StreamDecoder* acquireStreamDecoder(uint8_t encoding, uint32_t timeoutMs) {
+    if (encoding != CONTENT_ENCODING_GZIP && encoding != CONTENT_ENCODING_DEFLATE && encoding != CONTENT_ENCODING_LZ4) {
+        return nullptr;
+    }
+    if (!decoderLock) {
+        decoderLock = xSemaphoreCreateMutex();
+        freeDecoders = xSemaphoreCreateCounting(STREAM_DECODER_COUNT, STREAM_DECODER_COUNT);
+    }
+    if (!decoderLock || !freeDecoders || xSemaphoreTake(freeDecoders, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) return nullptr;
+
+    xSemaphoreTake(decoderLock, portMAX_DELAY);
+    StreamDecoder* decoder = nullptr;
+    for (int i = 0; i < STREAM_DECODER_COUNT && !decoder; i++) {
+        if (!decoders[i].inUse) decoder = &decoders[i];
+    }
+    decoder->inUse = true;
+    xSemaphoreGive(decoderLock);
+
+    // Windows only exist while a job decodes, so an idle device keeps the memory
+    decoder->encoding = encoding;
+    decoder->windowSize = encoding == CONTENT_ENCODING_LZ4 ? LZ4_WINDOW_SIZE : INFLATE_WINDOW_SIZE;
+    decoder->windowPos = 0;
+    decoder->windowFilled = 0;
+    decoder->pendingLength = 0;
+    decoder->window = allocateWindow(decoder->windowSize);
+    decoder->inflator = nullptr;
+    if (encoding != CONTENT_ENCODING_LZ4) {
+        decoder->inflator = (tinfl_decompressor*)heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_8BIT);
+    }
+    if (!decoder->window || (encoding != CONTENT_ENCODING_LZ4 && !decoder->inflator)) {
+        Serial.printf("[Decoder] Not enough memory for a %lu byte window. Free heap: %u\n",
+                      (unsigned long)decoder->windowSize, (unsigned int)ESP.getFreeHeap());
+        releaseStreamDecoder(decoder);
+        return nullptr;
+    }
+    beginMember(*decoder);
+    return decoder;
+}
+
+void releaseStreamDecoder(StreamDecoder* decoder) {
+    if (!decoder) return;
+    heap_caps_free(decoder->window);
+    heap_caps_free(decoder->inflator);
+    decoder->window = nullptr;
+    decoder->inflator = nullptr;
+    xSemaphoreTake(decoderLock, portMAX_DELAY);
+    decoder->inUse = false;
+    xSemaphoreGive(decoderLock);
+    xSemaphoreGive(freeDecoders);
+}
+
+bool streamDecoderAtEnd(const StreamDecoder* decoder) {
+    return decoder->atBoundary && decoder->pendingLength == 0;
+}
+
+// Collects decoder.headerNeeded bytes. True once they are all there.
+static bool collectHeader(StreamDecoder& decoder, const uint8_t*& in, const uint8_t* inEnd) {
+    while (decoder.headerFill < decoder.headerNeeded && in < inEnd) {
+        decoder.header[decoder.headerFill++] = *in++;
+    }
+    if (decoder.headerFill < decoder.headerNeeded) return false;
+    decoder.headerFill = 0;
+    return true;
+}
+
+static inline uint32_t readLe32(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// Skips a NUL-terminated header field. True once the terminator has been read.
+static bool skipString(const uint8_t*& in, const uint8_t* inEnd) {
+    while (in < inEnd) {
+        if (*in++ == '\0') return true;
+    }
+    return false;
+}
+
+// Optional gzip header fields, in the order they appear; the deflate data follows them
+static const DecoderState gzipFields[] = { STATE_GZIP_EXTRA_LENGTH, STATE_GZIP_NAME, STATE_GZIP_COMMENT, STATE_GZIP_HEADER_CRC, STATE_INFLATE };
+static const uint8_t gzipFieldFlags[] = { GZIP_FLAG_EXTRA, GZIP_FLAG_NAME, GZIP_FLAG_COMMENT, GZIP_FLAG_HCRC, 0 };
+
+// Moves on to the first present field after gzipFields[done], or after the fixed header if done is -1
+static void nextGzipHeaderField(StreamDecoder& decoder, int done) {
+    int i = done + 1;
+    while (gzipFieldFlags[i] != 0 && !(decoder.gzipFlags & gzipFieldFlags[i])) i++;
+    decoder.state = gzipFields[i];
+    decoder.headerNeeded = 2;
+    decoder.skipRemaining = 2; // Only used by the header CRC
+}
+
+static DecodeStatus decodeDeflate(StreamDecoder& decoder, const uint8_t*& in, const uint8_t* inEnd, uint8_t*& out, uint8_t* outEnd,
+                                  bool inputEnds) {
+    while (in < inEnd || decoder.pendingLength > 0 || decoder.state == STATE_INFLATE) {
+        switch (decoder.state) {
+        case STATE_GZIP_HEADER:
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            if (decoder.header[0] != 0x1F || decoder.header[1] != 0x8B || decoder.header[2] != 8) {
+                Serial.println("[Decoder] Not a gzip stream.");
+                return DECODE_ERROR;
+            }
+            decoder.gzipFlags = decoder.header[3];
+            decoder.inflateFlags = 0; // Raw deflate inside gzip
+            nextGzipHeaderField(decoder, -1);
+            break;
+        case STATE_GZIP_EXTRA_LENGTH:
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            decoder.skipRemaining = decoder.header[0] | (decoder.header[1] << 8);
+            decoder.state = STATE_GZIP_EXTRA;
+            break;
+        case STATE_GZIP_EXTRA:
+        case STATE_GZIP_HEADER_CRC: {
+            uint32_t n = std::min((uint32_t)(inEnd - in), decoder.skipRemaining);
+            in += n;
+            decoder.skipRemaining -= n;
+            if (decoder.skipRemaining > 0) return DECODE_MORE;
+            nextGzipHeaderField(decoder, decoder.state == STATE_GZIP_EXTRA ? 0 : 3);
+            break;
+        }
+        case STATE_GZIP_NAME:
+        case STATE_GZIP_COMMENT:
+            if (!skipString(in, inEnd)) return DECODE_MORE;
+            nextGzipHeaderField(decoder, decoder.state == STATE_GZIP_NAME ? 1 : 2);
+            break;
+        case STATE_ZLIB_PROBE:
+            // HTTP "deflate" means zlib-wrapped, but some servers send raw deflate
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            {
+                bool zlib = (decoder.header[0] & 0x0F) == 8 && ((decoder.header[0] << 8) | decoder.header[1]) % 31 == 0;
+                decoder.inflateFlags = zlib ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0;
+                // Hand the probed bytes to tinfl before the rest of the input
+                size_t probeLength = 2;
+                size_t outLength = decoder.windowSize - decoder.windowPos;
+                tinfl_status status = tinfl_decompress(decoder.inflator, decoder.header, &probeLength, decoder.window,
+                                                       decoder.window + decoder.windowPos, &outLength,
+                                                       decoder.inflateFlags | TINFL_FLAG_HAS_MORE_INPUT);
+                if (status < 0 || probeLength != 2) return DECODE_ERROR;
+                decoder.pendingStart = decoder.windowPos;
+                decoder.pendingLength = outLength;
+                decoder.windowPos = (decoder.windowPos + outLength) & (decoder.windowSize - 1);
+                decoder.inflateDone = status == TINFL_STATUS_DONE;
+                decoder.inflateHasMore = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+            }
+            decoder.state = STATE_INFLATE;
+            break;
+        case STATE_INFLATE: {
+            if (decoder.pendingLength > 0) {
+                uint32_t n = std::min((uint32_t)(outEnd - out), decoder.pendingLength);
+                memcpy(out, decoder.window + decoder.pendingStart, n);
+                out += n;
+                decoder.pendingStart += n;
+                decoder.pendingLength -= n;
+                if (decoder.pendingLength > 0) return DECODE_MORE; // Output full
+            }
+            if (decoder.inflateDone) {
+                if (decoder.encoding == CONTENT_ENCODING_GZIP) {
+                    decoder.state = STATE_GZIP_TRAILER;
+                    decoder.headerNeeded = 8;
+                } else {
+                    // tinfl has checked the Adler-32 of a zlib stream; another one may follow
+                    beginMember(decoder);
+                    decoder.atBoundary = true;
+                    if (in == inEnd) return DECODE_MORE;
+                }
+                break;
+            }
+            if (in == inEnd && !decoder.inflateHasMore) return DECODE_MORE;
+            size_t inLength = inEnd - in;
+            size_t outLength = decoder.windowSize - decoder.windowPos;
+            tinfl_status status = tinfl_decompress(decoder.inflator, in, &inLength, decoder.window,
+                                                   decoder.window + decoder.windowPos, &outLength,
+                                                   decoder.inflateFlags | (inputEnds ? 0 : TINFL_FLAG_HAS_MORE_INPUT));
+            if (status < 0) {
+                Serial.printf("[Decoder] Corrupt deflate stream (status %d).\n", (int)status);
+                return DECODE_ERROR;
+            }
+            in += inLength;
+            if (decoder.encoding == CONTENT_ENCODING_GZIP) {
+                decoder.memberCrc = crc32_le(decoder.memberCrc, decoder.window + decoder.windowPos, outLength);
+                decoder.memberSize += outLength;
+            }
+            decoder.pendingStart = decoder.windowPos;
+            decoder.pendingLength = outLength;
+            decoder.windowPos = (decoder.windowPos + outLength) & (decoder.windowSize - 1);
+            decoder.inflateDone = status == TINFL_STATUS_DONE;
+            decoder.inflateHasMore = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+            break;
+        }
+        case STATE_GZIP_TRAILER:
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            if (readLe32(decoder.header) != decoder.memberCrc || readLe32(decoder.header + 4) != decoder.memberSize) {
+                Serial.println("[Decoder] gzip CRC or size mismatch.");
+                return DECODE_ERROR;
+            }
+            beginMember(decoder); // Concatenated members are allowed
+            decoder.atBoundary = true;
+            break;
+        default:
+            return DECODE_ERROR;
+        }
+    }
+    return DECODE_MORE;
+}
+
+static inline void lz4Emit(StreamDecoder& decoder, uint8_t*& out, uint8_t byte) {
+    *out++ = byte;
+    decoder.window[decoder.windowPos] = byte;
+    decoder.windowPos = (decoder.windowPos + 1) & (decoder.windowSize - 1);
+    if (decoder.windowFilled < decoder.windowSize) decoder.windowFilled++;
+}
+
+// Reads one byte of the current compressed block
+static inline uint8_t lz4BlockByte(StreamDecoder& decoder, const uint8_t*& in) {
+    decoder.blockRemaining--;
+    return *in++;
+}
+
+// After a block's last byte: its checksum if the frame has them, then the next block size.
+// Block and content checksums are skipped, not verified; TLS already protects the transfer.
+static void lz4EndBlock(StreamDecoder& decoder) {
+    decoder.headerNeeded = 4;
+    if (decoder.lz4Flags & 0x10) {
+        decoder.skipRemaining = 4;
+        decoder.state = STATE_LZ4_CHECKSUM;
+        decoder.afterChecksum = STATE_LZ4_BLOCK_SIZE;
+    } else {
+        decoder.state = STATE_LZ4_BLOCK_SIZE;
+    }
+}
+
+static DecodeStatus decodeLz4(StreamDecoder& decoder, const uint8_t*& in, const uint8_t* inEnd, uint8_t*& out, uint8_t* outEnd) {
+    for (;;) {
+        switch (decoder.state) {
+        case STATE_LZ4_MAGIC: {
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            uint32_t magic = readLe32(decoder.header);
+            if ((magic & 0xFFFFFFF0) == LZ4_SKIPPABLE_MAGIC) {
+                decoder.state = STATE_LZ4_SKIP;
+                decoder.skipRemaining = 0xFFFFFFFF; // Size follows
+                decoder.headerNeeded = 4;
+            } else if (magic == LZ4_FRAME_MAGIC) {
+                decoder.state = STATE_LZ4_DESCRIPTOR;
+                decoder.headerNeeded = 2;
+            } else {
+                Serial.println("[Decoder] Not an LZ4 frame.");
+                return DECODE_ERROR;
+            }
+            break;
+        }
+        case STATE_LZ4_SKIP:
+        case STATE_LZ4_CHECKSUM: {
+            if (decoder.skipRemaining == 0xFFFFFFFF) {
+                if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+                decoder.skipRemaining = readLe32(decoder.header);
+            }
+            uint32_t n = std::min((uint32_t)(inEnd - in), decoder.skipRemaining);
+            in += n;
+            decoder.skipRemaining -= n;
+            if (decoder.skipRemaining > 0) return DECODE_MORE;
+            decoder.state = decoder.state == STATE_LZ4_SKIP ? STATE_LZ4_MAGIC : decoder.afterChecksum;
+            decoder.headerNeeded = 4;
+            if (decoder.state == STATE_LZ4_MAGIC) decoder.atBoundary = true;
+            break;
+        }
+        case STATE_LZ4_DESCRIPTOR: {
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            decoder.lz4Flags = decoder.header[0];
+            if ((decoder.lz4Flags >> 6) != 1 || (decoder.lz4Flags & 0x01)) {
+                Serial.println("[Decoder] Unsupported LZ4 frame version or dictionary.");
+                return DECODE_ERROR;
+            }
+            // Skip the optional content size and the header checksum
+            decoder.skipRemaining = ((decoder.lz4Flags & 0x08) ? 8 : 0) + 1;
+            decoder.state = STATE_LZ4_CHECKSUM;
+            decoder.afterChecksum = STATE_LZ4_BLOCK_SIZE;
+            break;
+        }
+        case STATE_LZ4_BLOCK_SIZE: {
+            if (!collectHeader(decoder, in, inEnd)) return DECODE_MORE;
+            uint32_t size = readLe32(decoder.header);
+            if (size == 0) { // End mark, then the optional content checksum
+                decoder.skipRemaining = (decoder.lz4Flags & 0x04) ? 4 : 0;
+                decoder.state = STATE_LZ4_SKIP;
+                if (decoder.skipRemaining == 0) {
+                    decoder.state = STATE_LZ4_MAGIC;
+                    decoder.atBoundary = true;
+                }
+                break;
+            }
+            decoder.blockRemaining = size & 0x7FFFFFFF;
+            decoder.state = (size & 0x80000000) ? STATE_LZ4_RAW : STATE_LZ4_TOKEN;
+            break;
+        }
+        case STATE_LZ4_RAW:
+            while (decoder.blockRemaining > 0 && in < inEnd && out < outEnd) lz4Emit(decoder, out, lz4BlockByte(decoder, in));
+            if (decoder.blockRemaining > 0) return DECODE_MORE;
+            lz4EndBlock(decoder);
+            break;
+        case STATE_LZ4_TOKEN:
+            if (decoder.blockRemaining == 0) {
+                lz4EndBlock(decoder);
+                break;
+            }
+            if (in == inEnd) return DECODE_MORE;
+            decoder.token = lz4BlockByte(decoder, in);
+            decoder.literalsRemaining = decoder.token >> 4;
+            decoder.state = decoder.literalsRemaining == 15 ? STATE_LZ4_LITERAL_LENGTH : STATE_LZ4_LITERALS;
+            break;
+        case STATE_LZ4_LITERAL_LENGTH:
+            while (in < inEnd && decoder.blockRemaining > 0) {
+                uint8_t byte = lz4BlockByte(decoder, in);
+                decoder.literalsRemaining += byte;
+                if (byte != 255) {
+                    decoder.state = STATE_LZ4_LITERALS;
+                    break;
+                }
+            }
+            if (decoder.state == STATE_LZ4_LITERAL_LENGTH) {
+                if (decoder.blockRemaining == 0) return DECODE_ERROR;
+                return DECODE_MORE;
+            }
+            break;
+        case STATE_LZ4_LITERALS:
+            while (decoder.literalsRemaining > 0 && decoder.blockRemaining > 0 && in < inEnd && out < outEnd) {
+                lz4Emit(decoder, out, lz4BlockByte(decoder, in));
+                decoder.literalsRemaining--;
+            }
+            if (decoder.literalsRemaining > 0) {
+                if (decoder.blockRemaining == 0) return DECODE_ERROR;
+                return DECODE_MORE;
+            }
+            if (decoder.blockRemaining == 0) { // The last sequence of a block has no match
+                lz4EndBlock(decoder);
+                break;
+            }
+            decoder.state = STATE_LZ4_OFFSET;
+            decoder.headerNeeded = 2;
+            break;
+        case STATE_LZ4_OFFSET:
+            while (decoder.headerFill < 2 && in < inEnd && decoder.blockRemaining > 0) {
+                decoder.header[decoder.headerFill++] = lz4BlockByte(decoder, in);
+            }
+            if (decoder.headerFill < 2) {
+                if (decoder.blockRemaining == 0) return DECODE_ERROR;
+                return DECODE_MORE;
+            }
+            decoder.headerFill = 0;
+            decoder.matchOffset = decoder.header[0] | (decoder.header[1] << 8);
+            if (decoder.matchOffset == 0 || decoder.matchOffset > decoder.windowFilled) {
+                Serial.println("[Decoder] Corrupt LZ4 match offset.");
+                return DECODE_ERROR;
+            }
+            decoder.matchRemaining = (decoder.token & 0x0F) + 4;
+            decoder.state = (decoder.token & 0x0F) == 15 ? STATE_LZ4_MATCH_LENGTH : STATE_LZ4_MATCH;
+            break;
+        case STATE_LZ4_MATCH_LENGTH:
+            while (in < inEnd && decoder.blockRemaining > 0) {
+                uint8_t byte = lz4BlockByte(decoder, in);
+                decoder.matchRemaining += byte;
+                if (byte != 255) {
+                    decoder.state = STATE_LZ4_MATCH;
+                    break;
+                }
+            }
+            if (decoder.state == STATE_LZ4_MATCH_LENGTH) {
+                if (decoder.blockRemaining == 0) return DECODE_ERROR;
+                return DECODE_MORE;
+            }
+            break;
+        case STATE_LZ4_MATCH:
+            while (decoder.matchRemaining > 0 && out < outEnd) {
+                lz4Emit(decoder, out, decoder.window[(decoder.windowPos - decoder.matchOffset) & (decoder.windowSize - 1)]);
+                decoder.matchRemaining--;
+            }
+            if (decoder.matchRemaining > 0) return DECODE_MORE; // Output full
+            decoder.state = STATE_LZ4_TOKEN;
+            break;
+        default:
+            return DECODE_ERROR;
+        }
+    }
+}
+
+DecodeStatus streamDecode(StreamDecoder* decoder, const uint8_t* in, size_t& inLength, uint8_t* out, size_t& outLength, bool inputEnds) {
+    const uint8_t* inNext = in;
+    uint8_t* outNext = out;
+    if (inLength > 0) decoder->atBoundary = false; // Set again if a member or frame ends in this input
+    DecodeStatus status = decoder->encoding == CONTENT_ENCODING_LZ4
+        ? decodeLz4(*decoder, inNext, in + inLength, outNext, out + outLength)
+        : decodeDeflate(*decoder, inNext, in + inLength, outNext, out + outLength, inputEnds);
+    inLength = inNext - in;
+    outLength = outNext - out;
+    return status;
+}